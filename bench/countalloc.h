@@ -0,0 +1,43 @@
+/* countalloc.h: Allocation counting for the benchmark driver.
+ *
+ * Licensed under the GNU General Public License. No warranty.
+ * See COPYING for details.
+ */
+
+#ifndef	HEADER_countalloc_h_
+#define	HEADER_countalloc_h_
+
+#include	<cstdlib>
+#include	<cstring>
+#include	<cstdio>
+
+/* The number of calls to malloc(), calloc() and realloc() made by the
+ * code compiled with this header.
+ */
+extern unsigned long	benchallocs;
+
+static inline void *countedmalloc(size_t n)
+{
+	++benchallocs;
+	return malloc(n);
+}
+
+static inline void *countedcalloc(size_t n, size_t size)
+{
+	++benchallocs;
+	return calloc(n, size);
+}
+
+static inline void *countedrealloc(void *p, size_t n)
+{
+	++benchallocs;
+	return realloc(p, n);
+}
+
+/* Everything included after this point has its allocations counted.
+ */
+#define	malloc(n)		countedmalloc(n)
+#define	calloc(n, size)		countedcalloc(n, size)
+#define	realloc(p, n)		countedrealloc(p, n)
+
+#endif
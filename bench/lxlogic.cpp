@@ -0,0 +1,5 @@
+/* lxlogic.cpp: The Lynx logic module, compiled with allocation counting.
+ */
+
+#include	"countalloc.h"
+#include	"../src/lxlogic.cpp"
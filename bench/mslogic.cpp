@@ -0,0 +1,5 @@
+/* mslogic.cpp: The MS logic module, compiled with allocation counting.
+ */
+
+#include	"countalloc.h"
+#include	"../src/mslogic.cpp"
@@ -0,0 +1,364 @@
+/* twbench.cpp: Logic throughput benchmark.
+ *
+ * Licensed under the GNU General Public License. No warranty.
+ * See COPYING for details.
+ */
+
+/*
+ * This program runs the game logic without any user interface, for a
+ * fixed number of ticks per ruleset, and reports how fast it went.
+ * Every level of each data file is played in turn under both rulesets,
+ * with Chip steered by a pseudorandom input stream, so that two runs
+ * with the same arguments do exactly the same work. A checksum of the
+ * final game states is printed as well; if an engine change alters the
+ * checksum, it has also altered the game's behavior.
+ *
+ * With -c, each attempt is also snapshotted partway through, and the
+ * snapshot is restored into a second instance of the engine, which then
+ * plays on alongside the first. Any difference between the two games
+ * is reported as a mismatch.
+ */
+
+#include	<chrono>
+#include	<vector>
+#include	<algorithm>
+#include	<cstdlib>
+#include	<cstring>
+#include	<cstdio>
+
+#include	"defs.h"
+#include	"state.h"
+#include	"encoding.h"
+#include	"random.h"
+#include	"logic.h"
+#include	"err.h"
+#include	"profile.h"
+
+/* The counter incremented by the allocation-counting logic modules.
+ */
+unsigned long	benchallocs = 0;
+
+/* The longest a single attempt at a level is allowed to run, in ticks.
+ */
+#define	MAX_ATTEMPT_TICKS	(300 * TICKS_PER_SECOND)
+
+/* The tick at which an attempt is snapshotted when checking snapshots.
+ */
+#define	SNAPSHOT_TICK		(2 * TICKS_PER_SECOND)
+
+/* The results of a run of one ruleset over one data file.
+ */
+typedef struct benchresult {
+	long		ticks;		/* total ticks simulated */
+	long		attempts;	/* number of level attempts */
+	unsigned long	allocs;		/* allocations made by the logic */
+	double		seconds;	/* time spent in the logic */
+	unsigned long	checksum;	/* hash of the final game states */
+	long		checked;	/* snapshots restored and checked */
+	long		mismatches;	/* checked snapshots that diverged */
+	std::vector<int> nspertick;	/* time taken by each tick */
+} benchresult;
+
+/* Read the levels of an MS data file into games. FALSE is returned if
+ * the file could not be read.
+ */
+static bool readdatfile(char const *filename, std::vector<gamesetup> &games,
+			std::vector<unsigned char> &buf)
+{
+	FILE	       *fp;
+	gamesetup	game;
+	size_t		pos, size;
+	long		n;
+	int		count;
+
+	if (!(fp = fopen(filename, "rb"))) {
+		perror(filename);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	buf.resize(n > 0 ? n : 0);
+	if (n <= 6 || fread(buf.data(), 1, n, fp) != (size_t)n) {
+		fprintf(stderr, "%s: unable to read data file\n", filename);
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+	if (buf[0] != 0xAC || buf[1] != 0xAA) {
+		fprintf(stderr, "%s: not a valid data file\n", filename);
+		return false;
+	}
+
+	count = buf[4] | (buf[5] << 8);
+	games.clear();
+	for (pos = 6 ; count-- && pos + 2 <= buf.size() ; pos += size) {
+		size = buf[pos] | (buf[pos + 1] << 8);
+		pos += 2;
+		if (size < 10 || pos + size > buf.size())
+			break;
+		memset(&game, 0, sizeof game);
+		game.leveldata = buf.data() + pos;
+		game.levelsize = size;
+		game.number = game.leveldata[0] | (game.leveldata[1] << 8);
+		game.time = game.leveldata[2] | (game.leveldata[3] << 8);
+		game.besttime = TIME_NIL;
+		games.push_back(game);
+	}
+	if (games.empty()) {
+		fprintf(stderr, "%s: no levels found\n", filename);
+		return false;
+	}
+	return true;
+}
+
+/* Set up state to start the given level, in the same way as play.cpp.
+ */
+static bool startlevel(gamestate *state, gamelogic *logic, gamesetup *game,
+		       int ruleset, unsigned long seed)
+{
+	memset(state->map, 0, sizeof state->map);
+	state->game = game;
+	state->ruleset = ruleset;
+	state->replay = -1;
+	state->currenttime = -1;
+	state->timeoffset = 0;
+	state->currentinput = NIL;
+	state->lastmove = NIL;
+	state->initrndslidedir = NIL;
+	state->stepping = -1;
+	state->statusflags = 0;
+	state->soundeffects = 0;
+	state->timelimit = game->time * TICKS_PER_SECOND;
+	restartprng(&state->mainprng, seed);
+	if (!expandleveldata(state))
+		return false;
+	return (*logic->initgame)(logic);
+}
+
+/* Fold the parts of the game state that the logic is responsible for
+ * into the checksum.
+ */
+static unsigned long hashstate(unsigned long h, gamestate const *state)
+{
+	unsigned char const    *p;
+	size_t			n;
+
+	p = (unsigned char const *)state->map;
+	for (n = 0 ; n < sizeof state->map ; ++n)
+		h = (h ^ p[n]) * 16777619UL;
+	h = (h ^ (unsigned long)state->currenttime) * 16777619UL;
+	h = (h ^ (unsigned long)state->chipsneeded) * 16777619UL;
+	h = (h ^ (unsigned long)state->statusflags) * 16777619UL;
+	return h & 0xFFFFFFFFUL;
+}
+
+/* Advance the game by one tick with the given input.
+ */
+static int advance(gamestate *state, gamelogic *logic, int tick, int cmd)
+{
+	int	n;
+
+	state->soundeffects &= ~((1 << SND_ONESHOT_COUNT) - 1);
+	state->currenttime = tick;
+	state->currentinput = cmd;
+	n = (*logic->advancegame)(logic);
+	state->lastmove = NIL;
+	return n;
+}
+
+/* Copy the game in progress, engine data included, into the second
+ * instance, in the same way as savegamesnapshot() and
+ * restoregamesnapshot() do. data is the buffer for the snapshot.
+ */
+static bool copygame(gamestate *state, gamelogic *logic,
+		     gamestate *copy, gamelogic *copylogic, void **data)
+{
+	(*logic->savesnapshot)(logic, data);
+	*copy = *state;
+	return (*copylogic->restoresnapshot)(copylogic, *data);
+}
+
+/* Run one ruleset over the levels for the given number of ticks. If
+ * check is TRUE, snapshots are restored into a second instance and
+ * checked against the first.
+ */
+static void runbench(std::vector<gamesetup> &games, int ruleset,
+		     long maxticks, unsigned long seed, bool check,
+		     benchresult *r)
+{
+	std::chrono::steady_clock::time_point	t0, t1;
+	gamestate      *state, *copy;
+	gamelogic      *logic, *copylogic;
+	void	       *snapshot = NULL;
+	prng		input;
+	unsigned long	allocs;
+	int		cmd, n, copyn, tick;
+	size_t		level, failures;
+	bool		copying;
+
+	logic = ruleset == Ruleset_MS ? mslogicstartup() : lynxlogicstartup();
+	copylogic = ruleset == Ruleset_MS ? mslogicstartup()
+					  : lynxlogicstartup();
+	if (!(state = (gamestate *)calloc(1, sizeof *state)))
+		memerrexit();
+	if (!(copy = (gamestate *)calloc(1, sizeof *copy)))
+		memerrexit();
+	logic->state = state;
+	copylogic->state = copy;
+	restartprng(&input, seed);
+
+	r->ticks = 0;
+	r->attempts = 0;
+	r->allocs = 0;
+	r->seconds = 0.0;
+	r->checksum = 2166136261UL;
+	r->checked = 0;
+	r->mismatches = 0;
+	r->nspertick.clear();
+	r->nspertick.reserve(maxticks);
+
+	failures = 0;
+	for (level = 0 ; r->ticks < maxticks ; level = (level + 1) % games.size()) {
+		++r->attempts;
+		if (!startlevel(state, logic, &games[level], ruleset,
+				seed + r->attempts)) {
+			(*logic->endgame)(logic);
+			if (++failures == games.size())
+				break;
+			continue;
+		}
+		failures = 0;
+		cmd = CmdNone;
+		n = 0;
+		copying = false;
+		for (tick = 0 ; !n && tick < MAX_ATTEMPT_TICKS
+				 && r->ticks < maxticks ; ++tick) {
+			if (check && tick == SNAPSHOT_TICK) {
+				++r->checked;
+				copying = copygame(state, logic, copy, copylogic,
+						   &snapshot);
+				if (!copying)
+					++r->mismatches;
+			}
+			if (!random4(&input))
+				cmd = random4(&input) ? 1 << random4(&input) : CmdNone;
+
+			allocs = benchallocs;
+			t0 = std::chrono::steady_clock::now();
+			n = advance(state, logic, tick, cmd);
+			t1 = std::chrono::steady_clock::now();
+			r->allocs += benchallocs - allocs;
+
+			r->nspertick.push_back((int)std::chrono::duration_cast
+				<std::chrono::nanoseconds>(t1 - t0).count());
+			r->seconds += std::chrono::duration<double>(t1 - t0).count();
+			++r->ticks;
+
+			if (copying) {
+				copyn = advance(copy, copylogic, tick, cmd);
+				if (copyn != n || hashstate(2166136261UL, copy)
+					       != hashstate(2166136261UL, state)) {
+					++r->mismatches;
+					copying = false;
+				}
+			}
+		}
+		r->checksum = hashstate(r->checksum, state);
+		(*logic->endgame)(logic);
+		if (check && tick > SNAPSHOT_TICK)
+			(*copylogic->endgame)(copylogic);
+	}
+
+	(*logic->shutdown)(logic);
+	(*copylogic->shutdown)(copylogic);
+	free(snapshot);
+	free(state);
+	free(copy);
+}
+
+/* Display one line of results.
+ */
+static void report(char const *name, int ruleset, benchresult *r)
+{
+	std::vector<int>       &ns = r->nspertick;
+	size_t			n = ns.size();
+
+	std::sort(ns.begin(), ns.end());
+	printf("%-16.16s %-4s %9ld %6ld %10.0f %6d %6d %6d %8d %8.4f  %08lX\n",
+		name, ruleset == Ruleset_MS ? "MS" : "Lynx",
+		r->ticks, r->attempts,
+		r->seconds > 0.0 ? r->ticks / r->seconds : 0.0,
+		n ? ns[n / 2] : 0, n ? ns[n * 9 / 10] : 0,
+		n ? ns[n * 99 / 100] : 0, n ? ns[n - 1] : 0,
+		r->ticks ? (double)r->allocs / r->ticks : 0.0,
+		r->checksum);
+	if (r->checked)
+		printf("%-16.16s %-4s %9ld snapshots checked, %ld mismatched\n",
+			name, ruleset == Ruleset_MS ? "MS" : "Lynx",
+			r->checked, r->mismatches);
+}
+
+/* Display a usage message and exit.
+ */
+static void usage(char const *prog, int status)
+{
+	fprintf(status ? stderr : stdout,
+		"Usage: %s [-n TICKS] [-s SEED] [-p] [-c] [-t] FILE.dat ...\n"
+		"  -n  ticks to simulate per ruleset and file (default 200000)\n"
+		"  -s  seed for the input streams and the game PRNG (default 1)\n"
+		"  -p  turn on pedantic mode for the Lynx ruleset\n"
+		"  -c  check that snapshots restore into a second instance\n"
+		"  -t  time each phase of the logic, as TWORLD_PROFILE does\n",
+		prog);
+	exit(status);
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<unsigned char>	buf;
+	std::vector<gamesetup>		games;
+	benchresult	r;
+	char const     *name;
+	long		maxticks = 200000;
+	unsigned long	seed = 1;
+	bool		check = false;
+	long		mismatches = 0;
+	int		i;
+
+	for (i = 1 ; i < argc && argv[i][0] == '-' ; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			maxticks = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			seed = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-p"))
+			pedanticmode = true;
+		else if (!strcmp(argv[i], "-c"))
+			check = true;
+		else if (!strcmp(argv[i], "-t"))
+			setprofiling(true);
+		else if (!strcmp(argv[i], "-h"))
+			usage(argv[0], EXIT_SUCCESS);
+		else
+			usage(argv[0], EXIT_FAILURE);
+	}
+	if (i == argc || maxticks <= 0)
+		usage(argv[0], EXIT_FAILURE);
+
+	printf("%-16s %-4s %9s %6s %10s %6s %6s %6s %8s %8s  %s\n",
+		"file", "rule", "ticks", "tries", "ticks/sec",
+		"p50ns", "p90ns", "p99ns", "maxns", "alloc/t", "checksum");
+	for ( ; i < argc ; ++i) {
+		if (!readdatfile(argv[i], games, buf))
+			return EXIT_FAILURE;
+		name = strrchr(argv[i], '/');
+		name = name ? name + 1 : argv[i];
+		runbench(games, Ruleset_MS, maxticks, seed, check, &r);
+		report(name, Ruleset_MS, &r);
+		mismatches += r.mismatches;
+		runbench(games, Ruleset_Lynx, maxticks, seed, check, &r);
+		report(name, Ruleset_Lynx, &r);
+		mismatches += r.mismatches;
+	}
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -88,7 +88,7 @@ $vars{CXX} = get_cmd_path('cxx');
 my @qt_modules = qw|QtCore QtGui QtXml QtWidgets|;
 
 # generic compiler flags
-$vars{CFLAGS} = '-std=gnu++17 -Wall -pedantic -DNDEBUG -O2 -I. -Werror -fPIC';
+$vars{CFLAGS} = '-std=gnu++17 -Wall -pedantic -DNDEBUG -O2 -I. -Werror -fPIC -pthread';
 
 # qt compiler flags (spaces after -isystem helps mingw gcc)
 $vars{CFLAGS} .= " -isystem $qt_vars{QT_INSTALL_HEADERS}";
@@ -104,7 +104,7 @@ $vars{CFLAGS} .= " $sdl2_config_cflags";
 # linker flags
 my $sdl2_config_libs = get_command_safe($sdl2_config, '--libs');
 $sdl2_config_libs =~ s|-L|-L |g;
-$vars{LDFLAGS} = $sdl2_config_libs;
+$vars{LDFLAGS} = "$sdl2_config_libs -pthread";
 
 # frameworks on Mac, libraries on other systems
 if($^O eq 'darwin') {
@@ -176,11 +176,21 @@ obj/moc_TWMainWnd.cpp: src/TWMainWnd.h $(CREATE_OBJ_DIR)
 obj/icon_tworld.o: src/tworld.ico $(CREATE_OBJ_DIR)
 	echo 1 ICON $< | $(WINDRES) -o $@
 
+# the logic benchmark, which needs neither qt nor sdl
+BENCH_FILES := bench/twbench.cpp bench/mslogic.cpp bench/lxlogic.cpp src/encoding.cpp src/random.cpp src/err.cpp src/profile.cpp
+
+twbench: $(BENCH_FILES) bench/countalloc.h src/mslogic.cpp src/lxlogic.cpp src/profile.h
+	$(CXX) $(CFLAGS) -Isrc -o $@ $(BENCH_FILES)
+
+.PHONY: bench
+bench: twbench
+	./twbench $(BENCH_ARGS) data/intro.dat $(BENCH_SETS)
+
 .PHONY: clean
 clean:
 	rm -fr 'Tile World.app'
 	rm -fr dist
-	rm -f obj/* $(TWORLD)
+	rm -f obj/* $(TWORLD) twbench
 
 .PHONY: app
 app: tworld
@@ -4,11 +4,16 @@
  */
 
 #include <QClipboard>
+#include <QCoreApplication>
+#include <QTimer>
 #include <SDL.h>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 
 #include "TWApp.h"
 #include "tworld.h"
+#include "play.h"
 #include "oshwbind.h"
 #include "timer.h"
 #include "sdlsfx.h"
@@ -18,6 +23,7 @@
 #include "messages.h"
 #include "unslist.h"
 #include "err.h"
+#include "res.h"
 
 TileWorldApp* g_pApp = 0;
 TileWorldMainWnd* g_pMainWnd = 0;
@@ -92,6 +98,12 @@ bool TileWorldApp::Initialize()
 	loadmessagesfromfile("messages.txt");
 	loadunslistfromfile("unslist.txt");
 
+	// read the tiles and sounds of both rulesets in the background once
+	// the event loop is running, so that switching between them later
+	// is immediate
+	if (getintsetting("preloadresources") != 0)
+		QTimer::singleShot(0, preloadgameresources);
+
 	return true;
 }
 
@@ -135,10 +147,53 @@ void TileWorldApp::ExitTWorld()
 }
 
 
+/* Run the headless solution verifier. Only a QCoreApplication is
+ * created, so no display, audio device, or tile images are needed.
+ */
+static int verifymain(int argc, char *argv[])
+{
+	char const *dacname = NULL;
+	char const *solutionfile = NULL;
+	char *end;
+	long jobs = 0;
+
+	for (int i = 2 ; i < argc ; ++i) {
+		if (!strcmp(argv[i], "--solutions") && i + 1 < argc) {
+			solutionfile = argv[++i];
+		} else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+			jobs = strtol(argv[++i], &end, 10);
+			if (*end || end == argv[i] || jobs < 1 || jobs > 4096) {
+				dacname = NULL;
+				break;
+			}
+		} else if (!dacname && argv[i][0] != '-') {
+			dacname = argv[i];
+		} else {
+			dacname = NULL;
+			break;
+		}
+	}
+	if (!dacname) {
+		fprintf(stderr, "usage: %s --verify SET.dac [--solutions FILE.tws]"
+			" [--jobs N]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("Tile World");
+	initdirs();
+	batchmode = true;
+
+	return tworldverify(dacname, solutionfile, (int)jobs);
+}
+
 /* The real main().
  */
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && !strcmp(argv[1], "--verify"))
+		return verifymain(argc, argv);
+
 	TileWorldApp app(argc, argv);
 	if(!app.Initialize()) return 1;
 	return tworld();
@@ -5,6 +5,8 @@
 
 #include <QPainter>
 
+#include <cmath>
+
 #include "TWDisplayWidget.h"
 
 TWDisplayWidget::TWDisplayWidget(QWidget* pParent)
@@ -14,20 +16,31 @@ TWDisplayWidget::TWDisplayWidget(QWidget* pParent)
 }
 
 
+// The pixmap is expected to be drawn at the widget's size in device
+// pixels already, so it is kept as is and painted when Qt next gets
+// around to it, rather than immediately.
 void TWDisplayWidget::setPixmap(const QPixmap& pixmap)
 {
-	m_pixmap = pixmap.scaled(size(), Qt::KeepAspectRatio);
-	repaint();
+	m_pixmap = pixmap;
+	update();
 }
 
 QSize TWDisplayWidget::sizeHint() const
 {
-	return m_pixmap.size();
+	return (QSizeF(m_pixmap.size()) / devicePixelRatioF()).toSize();
 }
 
 
+// A pixmap that matches the widget is drawn one pixmap pixel to one
+// device pixel, which needs no scaling. Any other pixmap (such as the
+// last frame drawn before a zoom change) is scaled to fit.
 void TWDisplayWidget::paintEvent(QPaintEvent* pPaintEvent)
 {
+	QSizeF size = QSizeF(m_pixmap.size()) / devicePixelRatioF();
+	if (ceil(size.width()) != width() || ceil(size.height()) != height())
+		size.scale(this->size(), Qt::KeepAspectRatio);
+
 	QPainter painter(this);
-	painter.drawPixmap(0, 0, m_pixmap);
+	painter.drawPixmap(QRectF(QPointF(0, 0), size), m_pixmap,
+		QRectF(m_pixmap.rect()));
 }
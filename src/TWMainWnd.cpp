@@ -25,6 +25,8 @@
 #include <QTimer>
 #include <QFontMetrics>
 #include <QRect>
+#include <QScreen>
+#include <QGuiApplication>
 
 #include <cstring>
 #include <cmath>
@@ -392,11 +394,11 @@ void TileWorldMainWnd::ReleaseAllKeys()
  * Video output functions.
  */
 
-/* Create a display surface appropriate to the requirements of the
- * game (e.g., sized according to the tiles and the font). FALSE is
- * returned on error.
+/* Create the surfaces that the map view and the inventory are drawn
+ * on, sized according to the tiles, and fit the display widgets to
+ * them.
  */
-void TileWorldMainWnd::CreateGameDisplay()
+void TileWorldMainWnd::CreateSurfaces()
 {
 	delete m_pSurface;
 	delete m_pInvSurface;
@@ -405,13 +407,38 @@ void TileWorldMainWnd::CreateGameDisplay()
 	m_pSurface = new Qt_Surface(w, h, false);
 	m_pInvSurface = new Qt_Surface(4*geng.wtile, 2*geng.htile, false);
 
+	geng.screen = m_pSurface;
+	m_disploc = TW_Rect(0, 0, w, h);
+
+	double const dpr = devicePixelRatioF();
+	m_pGameWidget->setFixedSize(ceil(w / dpr), ceil(h / dpr));
+	m_pObjectsWidget->setFixedSize(ceil(4*geng.wtile / dpr),
+		ceil(2*geng.htile / dpr));
+}
+
+/* Return the size in device pixels that tiles are shown at for the
+ * current zoom.
+ */
+int TileWorldMainWnd::DisplayTileSize() const
+{
+	return qRound(DEFAULTTILE * scale * devicePixelRatioF());
+}
+
+/* Create a display surface appropriate to the requirements of the
+ * game (e.g., sized according to the tiles and the font). FALSE is
+ * returned on error.
+ */
+void TileWorldMainWnd::CreateGameDisplay()
+{
+	// render the tiles at the size they are shown at, so that the
+	// display widgets never need to rescale them
+	scaletileset(DisplayTileSize());
+	CreateSurfaces();
+
 	// this sets the game and objects box
 	m_pGameWidget->setPixmap(m_pSurface->GetPixmap());
 	m_pObjectsWidget->setPixmap(m_pInvSurface->GetPixmap());
 
-	geng.screen = m_pSurface;
-	m_disploc = TW_Rect(0, 0, w, h);
-
 	SetCurrentPage(PAGE_GAME);
 
 	m_pControlsFrame->setVisible(true);
@@ -580,12 +607,14 @@ void TileWorldMainWnd::DisplayGame(const gamestate* pState, int nTimeLeft, int n
 	}
 
 	// draw objects widget
+	m_pInvSurface->BeginBatch();
 	for (int i = 0; i < 4; ++i) {
 		drawfulltileid(m_pInvSurface, i*geng.wtile, 0,
 			(pState->keys[i] ? Key_Red+i : Empty));
 		drawfulltileid(m_pInvSurface, i*geng.wtile, geng.htile,
 			(pState->boots[i] ? Boots_Ice+i : Empty));
 	}
+	m_pInvSurface->EndBatch();
 	m_pObjectsWidget->setPixmap(m_pInvSurface->GetPixmap());
 
 	// chips left
@@ -724,6 +753,16 @@ void TileWorldMainWnd::OnSpeedValueChanged(int nValue)
 
 void TileWorldMainWnd::SetSpeed(int nValue)
 {
+	// The far right of the slider runs the replay as fast as possible,
+	//  showing no more frames than the screen can
+	if (nValue > 0 && nValue == m_pSldSpeed->maximum()) {
+		QScreen* pScreen = QGuiApplication::primaryScreen();
+		qreal dRate = pScreen ? pScreen->refreshRate() : 0;
+		settimerturbo(dRate >= 1 ? qMax(1, qRound(1000 / dRate)) : 16);
+		return;
+	}
+	settimerturbo(0);
+
 	int nMS = (m_nRuleset == Ruleset_MS) ? 1100 : 1000;
 	if (nValue >= 0)
 		settimersecond(nMS >> nValue);
@@ -813,7 +852,9 @@ int TileWorldMainWnd::DisplayEndMessage(int nBaseScore, int nTimeScore, long lTo
 
 		Qt_Surface* pSurface = new Qt_Surface(geng.wtile, geng.htile, false);
 		drawfulltileid(pSurface, 0, 0, Exited_Chip);
-		msgBox.setIconPixmap(pSurface->GetPixmap());
+		QPixmap icon = pSurface->GetPixmap();
+		icon.setDevicePixelRatio(devicePixelRatioF());
+		msgBox.setIconPixmap(icon);
 		delete pSurface;
 
 		msgBox.setWindowTitle(m_bReplay ? "Replay Completed" : "Level Completed");
@@ -1271,6 +1312,7 @@ int TileWorldMainWnd::GetTWKeyForAction(QAction* pAction) const
 
 	if (pAction == action_Pause) return TWC_PAUSEGAME;
 	if (pAction == action_Restart) return TWC_SAMELEVEL;
+	if (pAction == action_Rewind) return TWC_REWIND;
 	if (pAction == action_Next) return TWC_NEXTLEVEL;
 	if (pAction == action_Previous) return TWC_PREVLEVEL;
 	if (pAction == action_GoTo) return TWC_GOTOLEVEL;
@@ -1342,13 +1384,11 @@ void TileWorldMainWnd::SetScale(int s, bool checkPrevScale)
 		SetHintVisibility(false);
 	}
 
-	// align widget size to specified scale
-	m_pGameWidget->setFixedSize(scale * DEFAULTTILE * NXTILES, scale * DEFAULTTILE * NYTILES);
-	m_pObjectsWidget->setFixedSize(scale * DEFAULTTILE * 4, scale * DEFAULTTILE * 2);
-
-	// this sets the game and objects box
-	m_pGameWidget->setPixmap(m_pSurface->GetPixmap());
-	m_pObjectsWidget->setPixmap(m_pInvSurface->GetPixmap());
+	// rescale the tiles, and remake the surfaces (which also aligns
+	// the widget sizes); the widgets show their last picture scaled
+	// until the next frame is drawn at the new size
+	if (scaletileset(DisplayTileSize()))
+		CreateSurfaces();
 
 	// this aligns the width of the objects box with the other elements
 	// in the right column
@@ -1450,9 +1490,9 @@ int TileWorldMainWnd::WindowMapPos(int x, int y)
 	if (x < 0 || y < 0)
 		return -1;
 
-	double t = DEFAULTTILE * scale;
-	x *= 4 / t;
-	y *= 4 / t;
+	double const dpr = devicePixelRatioF();
+	x *= 4 * dpr / geng.wtile;
+	y *= 4 * dpr / geng.htile;
 
 	if (x >= NXTILES * 4 || y >= NYTILES * 4)
 		return -1;
@@ -94,6 +94,7 @@ public:
 
 		TWC_PAUSEGAME,
 		TWC_LOSEFOCUS,
+		TWC_REWIND,
 
 		TWC_SAMELEVEL,
 		TWC_NEXTLEVEL,
@@ -136,6 +137,7 @@ public:
 
 		{	TWC_PAUSEGAME,			CmdPauseGame,			false	},
 		{	TWC_LOSEFOCUS,			CmdLostFocus,			false	},
+		{	TWC_REWIND,				CmdRewind,				false	},
 
 		{	TWC_SAMELEVEL,			CmdSameLevel,			false	},
 		{	TWC_NEXTLEVEL,			CmdNextLevel,			false	},
@@ -255,6 +257,8 @@ private:
 	void SetHintText(QString hint);
 	void SetHintVisibility(bool newmode);
 	void SetScale(int s, bool checkPrevScale = true);
+	void CreateSurfaces();
+	int DisplayTileSize() const;
 
 	bool m_bWindowClosed;
 
@@ -128,6 +128,7 @@ enum {
 	CmdQuit,
 	CmdPreserve,
 	CmdSeek,
+	CmdRewind,
 #ifndef NDEBUG
 	CmdDebugCmd1,
 	CmdDebugCmd2,
@@ -12,8 +12,8 @@
 
 /* "Hidden" arguments to warn_, and die_.
  */
-char const      *err_cfile_ = NULL;
-unsigned long	err_lineno_ = 0;
+thread_local char const *err_cfile_ = NULL;
+thread_local unsigned long err_lineno_ = 0;
 
 /* Values used for the first argument of usermessage().
  */
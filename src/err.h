@@ -25,10 +25,11 @@ extern void warn_(char const *fmt, ...);
 extern void die_(char const *fmt, ...) __attribute__((noreturn));
 
 /* A really ugly hack used to smuggle extra arguments into variadic
- * functions.
+ * functions. (Per-thread, so that concurrent replays don't mix up
+ * each other's locations.)
  */
-extern char const      *err_cfile_;
-extern unsigned long	err_lineno_;
+extern thread_local char const *err_cfile_;
+extern thread_local unsigned long err_lineno_;
 #define	warn	(err_cfile_ = __FILE__, err_lineno_ = __LINE__, warn_)
 #define	die	(err_cfile_ = __FILE__, err_lineno_ = __LINE__, die_)
 
@@ -323,9 +323,9 @@ fileinfo::fileinfo(int d, char const *fn)
 }
 
 /* Open a file from of the directories RESDIR, SERIESDIR, USER_SERIESDATDIR,
- * GLOBAL_SERIESDATDIR, SOLUTIONDIR, or SETTINGSDIR. If the fileinfo structure
- * does not already have a filename assigned to it, use name (after making an
- * independent copy).
+ * GLOBAL_SERIESDATDIR, SOLUTIONDIR, SETTINGSDIR, or CACHEDIR. If the fileinfo
+ * structure does not already have a filename assigned to it, use name (after
+ * making an independent copy).
  */
 bool fileinfo::open(char const *mode, char const *msg)
 {
@@ -429,10 +429,17 @@ void initdirs()
 	QString userSolDir = QString(userDir + "/solutions");
 	checkDir(userSolDir);
 
+	// ~/Library/Caches/Tile World
+	// (optional; without it, nothing is cached)
+	QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	bool haveCacheDir = !cacheDir.isEmpty() && QDir().mkpath(cacheDir);
+
 	savedir(RESDIR, appResDir);
 	savedir(SERIESDIR, userSetsDir);
 	savedir(USER_SERIESDATDIR, userDataDir);
 	savedir(GLOBAL_SERIESDATDIR, appDataDir);
 	savedir(SOLUTIONDIR, userSolDir);
 	savedir(SETTINGSDIR, userDir);
+	if (haveCacheDir)
+		savedir(CACHEDIR, cacheDir);
 }
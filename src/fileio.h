@@ -18,6 +18,7 @@ enum {
 	GLOBAL_SERIESDATDIR,
 	SOLUTIONDIR,
 	SETTINGSDIR,
+	CACHEDIR,
 	NUMBER_OF_DIRS
 };
 
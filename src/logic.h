@@ -13,19 +13,31 @@
 #define	back(dir)	((((dir) << 2) | ((dir) >> 2)) & 15)
 #define	right(dir)	((((dir) << 3) | ((dir) >> 1)) & 15)
 
-/* One game logic engine.
+/* One instance of a game logic engine. Instances are independent of
+ * each other, so several games can be simulated side by side.
+ *
+ * savesnapshot stores a copy of everything the engine keeps about the
+ * game in progress, apart from the gamestate itself, in a buffer that
+ * it (re)allocates, and returns the size of the buffer.
+ * restoresnapshot reinstates such a copy and repoints the gamestate's
+ * pointers into the engine's own memory, so a snapshot taken on one
+ * instance can be restored on any instance of the same ruleset.
  */
 typedef	struct gamelogic gamelogic;
 struct gamelogic {
 	int		ruleset;		  /* the ruleset */
 	gamestate  *state;			  /* ptr to the current game state */
+	void       *context;			  /* the engine's private data */
 	bool	  (*initgame)(gamelogic*);	  /* prepare to play a game */
 	int	      (*advancegame)(gamelogic*); /* advance the game one tick */
 	bool	  (*endgame)(gamelogic*);	  /* clean up after the game is done */
+	size_t	  (*savesnapshot)(gamelogic*, void**);	/* copy private data */
+	bool	  (*restoresnapshot)(gamelogic*, void const*); /* reinstate it */
 	void      (*shutdown)(gamelogic*);	  /* turn off the logic engine */
 };
 
-/* The available game logic engines.
+/* The available game logic engines. Each call creates a new instance,
+ * which is destroyed by calling its shutdown function.
  */
 extern gamelogic *lynxlogicstartup(void);
 extern gamelogic *mslogicstartup(void);
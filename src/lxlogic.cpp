@@ -5,6 +5,7 @@
  */
 
 #include	<cstdlib>
+#include	<cstring>
 #include	<cstdio>
 
 #include	"defs.h"
@@ -12,12 +13,17 @@
 #include	"random.h"
 #include	"logic.h"
 #include	"err.h"
+#include	"profile.h"
 
 /* A number well above the maximum number of creatures that could possibly
  * exist simultaneously.
  */
 #define	MAX_CREATURES	(2 * CXGRID * CYGRID)
 
+/* The number of 64-bit words needed for a bit per creature slot.
+ */
+#define	CRFREEWORDS	((MAX_CREATURES + 1 + 63) / 64)
+
 /* The maximum number of creatures on the original Atari Lynx version.
  */
 #define	PMAX_CREATURES	128
@@ -63,30 +69,39 @@ static int advancecreature(creature *cr, bool releasing);
  */
 static int const	delta[] = { 0, -CXGRID, -1, 0, +CXGRID, 0, 0, 0, +1 };
 
-/* The direction used the last time something stepped onto a random
- * slide floor.
- */
-static int		lastrndslidedir = NORTH;
-
-/* The most recently used stepping phase value.
- */
-static int		laststepping = 0;
-
-/* The memory used to hold the list of creatures.
- */
-static creature	       *creaturearray = NULL;
-
-/* A pointer to the game state, used so that it doesn't have to be
- * passed to every single function.
- */
-static gamestate       *state;
+/* The data private to one instance of the logic engine.
+ */
+typedef struct lxlogiccontext {
+	creature       *creaturearray;	/* memory holding the creature list */
+	int		lastrndslidedir;	/* last direction of a random slide */
+	int		laststepping;		/* most recent stepping value */
+	short		crathead[CXGRID * CYGRID];	/* first creature at */
+	short		cratnext[MAX_CREATURES + 1];	/* next creature at */
+	short		cratpos[MAX_CREATURES + 1];	/* where indexed */
+	unsigned long long crfree[CRFREEWORDS];	/* reusable slots */
+	unsigned long long crfreewords;		/* nonzero words of crfree */
+	short		trapwiring[CXGRID * CYGRID];	/* trap for each button */
+	short		clonerwiring[CXGRID * CYGRID];	/* cloner for each button */
+	short		nextbeartrap[CXGRID * CYGRID];	/* pedantic wiring */
+	short		nextcloner[CXGRID * CYGRID];	/* pedantic wiring */
+} lxlogiccontext;
+
+/* Pointers to the game state and to the engine instance currently
+ * running on this thread, used so that they don't have to be passed
+ * to every single function. Each entry point rebinds them from its
+ * gamelogic argument, so any number of instances can be advanced
+ * independently (and concurrently on separate threads).
+ */
+static thread_local gamestate	       *state;
+static thread_local lxlogiccontext     *ctx;
 
 /*
  * Accessor macros for various fields in the game state. Many of the
  * macros can be used as an lvalue.
  */
 
-#define	setstate(p)		(state = (p)->state)
+#define	setstate(p)		(state = (p)->state, \
+				 ctx = (lxlogiccontext *)(p)->context)
 
 #define	creaturelist()		(state->creatures)
 
@@ -232,8 +247,8 @@ static int getslidedir(int floor, bool advance)
 		case Slide_East:		return EAST;
 		case Slide_Random:
 			if (advance)
-				lastrndslidedir = right(lastrndslidedir);
-			return lastrndslidedir;
+				ctx->lastrndslidedir = right(ctx->lastrndslidedir);
+			return ctx->lastrndslidedir;
 	}
 	warn("Invalid floor %d handed to getslidedir()\n", floor);
 	_assert(!"getslidedir() called with an invalid object");
@@ -265,58 +280,78 @@ static void applyicewallturn(creature *cr)
 	cr->dir = dir;
 }
 
+/* Index the wiring of buttons to beartraps and clone machines by
+ * location. For the wiring given by the level, the first connection
+ * listed for a button is the one that counts. In pedantic mode a
+ * button is instead connected to the next beartrap or clone machine in
+ * reading order (wrapping around), so nextbeartrap and nextcloner
+ * record the next marked beartrap and the next clone machine after
+ * each location. Beartraps are marked once at the start of the level,
+ * and clone machines are never added, so the only change that matters
+ * is a clone machine being walled over, which clonerfrombutton()
+ * detects and handles by reindexing.
+ */
+static void indexwiring(void)
+{
+	xyconn     *xy;
+	int		trap, cloner, pos, n;
+
+	memset(ctx->trapwiring, -1, sizeof ctx->trapwiring);
+	for (n = traplistsize() - 1, xy = traplist() + n ; n >= 0 ; --n, --xy)
+		if (xy->from >= 0 && xy->from < CXGRID * CYGRID)
+			ctx->trapwiring[xy->from] = xy->to;
+	memset(ctx->clonerwiring, -1, sizeof ctx->clonerwiring);
+	for (n = clonerlistsize() - 1, xy = clonerlist() + n ; n >= 0 ; --n, --xy)
+		if (xy->from >= 0 && xy->from < CXGRID * CYGRID)
+			ctx->clonerwiring[xy->from] = xy->to;
+
+	trap = cloner = -1;
+	for (pos = 0 ; pos < CXGRID * CYGRID ; ++pos) {
+		if (trap < 0 && ismarkedbeartrap(pos))
+			trap = pos;
+		if (cloner < 0 && floorat(pos) == CloneMachine)
+			cloner = pos;
+	}
+	for (pos = CXGRID * CYGRID - 1 ; pos >= 0 ; --pos) {
+		ctx->nextbeartrap[pos] = trap == pos ? -1 : trap;
+		ctx->nextcloner[pos] = cloner == pos ? -1 : cloner;
+		if (ismarkedbeartrap(pos))
+			trap = pos;
+		if (floorat(pos) == CloneMachine)
+			cloner = pos;
+	}
+}
+
 /* Find the location of a beartrap from one of its buttons.
  */
 static int trapfrombutton(int pos)
 {
-	int		i;
-
-	if (pedanticmode) {
-		i = pos;
-		for (;;) {
-			++i;
-			if (i == CXGRID * CYGRID)
-				i = 0;
-			if (i == pos)
-				break;
-			if (floorat(i) == Beartrap)
-				return i;
-			if (ismarkedbeartrap(i))
-				return -1;
-		}
-	} else {
-		xyconn *xy;
-		for (xy = traplist(), i = traplistsize() ; i ; ++xy, --i)
-			if (xy->from == pos)
-				return xy->to;
-	}
-	return -1;
+	int		trap;
+
+	if (pos < 0 || pos >= CXGRID * CYGRID)
+		return -1;
+	if (!pedanticmode)
+		return ctx->trapwiring[pos];
+	trap = ctx->nextbeartrap[pos];
+	return trap >= 0 && floorat(trap) == Beartrap ? trap : -1;
 }
 
 /* Find the location of a clone machine from one of its buttons.
  */
 static int clonerfrombutton(int pos)
 {
-	int		i;
-
-	if (pedanticmode) {
-		i = pos;
-		for (;;) {
-			++i;
-			if (i == CXGRID * CYGRID)
-				i = 0;
-			if (i == pos)
-				break;
-			if (floorat(i) == CloneMachine)
-				return i;
-		}
-	} else {
-		xyconn *xy;
-		for (xy = clonerlist(), i = clonerlistsize() ; i ; ++xy, --i)
-			if (xy->from == pos)
-				return xy->to;
-	}
-	return -1;
+	int		cloner;
+
+	if (pos < 0 || pos >= CXGRID * CYGRID)
+		return -1;
+	if (!pedanticmode)
+		return ctx->clonerwiring[pos];
+	cloner = ctx->nextcloner[pos];
+	if (cloner >= 0 && floorat(cloner) != CloneMachine) {
+		indexwiring();
+		cloner = ctx->nextcloner[pos];
+	}
+	return cloner;
 }
 
 /* Quell any continuous sound effects coming from what Chip is
@@ -352,42 +387,153 @@ static void resetfloorsounds(bool includepushing)
 #define	setfdir(cr, d)	((cr)->state = ((cr)->state & ~CS_FDIRMASK) \
 				| ((d) & CS_FDIRMASK))
 
+/*
+ * The creature index.
+ *
+ * For each location, the index keeps a chain of the visible creatures
+ * (not counting animations) that are there, in the order that they
+ * appear in the creature list. Entries are creature list offsets, and
+ * -1 ends a chain. The index also has a bit set for every slot after
+ * Chip's that newcreature() could hand out, i.e. that is hidden or is
+ * the end of the list. Any code that changes a creature's position,
+ * its visibility, or its id must call indexcreature() afterwards.
+ */
+
+/* Return the position of the lowest set bit in a nonzero value.
+ */
+static int lowestbit(unsigned long long bits)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(bits);
+#else
+	int	n;
+
+	for (n = 0 ; !(bits & 1) ; bits >>= 1)
+		++n;
+	return n;
+#endif
+}
+
+/* Mark the nth slot as free or in use.
+ */
+static void setfreeslot(int n, bool isfree)
+{
+	if (isfree) {
+		ctx->crfree[n / 64] |= 1ULL << (n % 64);
+		ctx->crfreewords |= 1ULL << (n / 64);
+	} else {
+		ctx->crfree[n / 64] &= ~(1ULL << (n % 64));
+		if (!ctx->crfree[n / 64])
+			ctx->crfreewords &= ~(1ULL << (n / 64));
+	}
+}
+
+/* Return the offset of the first free slot, or -1 if there is none.
+ */
+static int firstfreeslot(void)
+{
+	int	w;
+
+	if (!ctx->crfreewords)
+		return -1;
+	w = lowestbit(ctx->crfreewords);
+	return w * 64 + lowestbit(ctx->crfree[w]);
+}
+
+/* Remove the nth creature from the index.
+ */
+static void unindexcreature(int n)
+{
+	short      *link;
+
+	if (ctx->cratpos[n] < 0)
+		return;
+	link = &ctx->crathead[ctx->cratpos[n]];
+	while (*link != n)
+		link = &ctx->cratnext[*link];
+	*link = ctx->cratnext[n];
+	ctx->cratpos[n] = -1;
+}
+
+/* Bring the index up to date with the given creature's current state.
+ */
+static void indexcreature(creature const *cr)
+{
+	short      *link;
+	int		n, pos;
+
+	n = cr - creaturelist();
+	if (n)
+		setfreeslot(n, !cr->id || cr->hidden);
+	pos = cr->pos;
+	if (!cr->id || cr->hidden || isanimation(cr->id)
+		    || pos < 0 || pos >= CXGRID * CYGRID) {
+		unindexcreature(n);
+		return;
+	}
+	if (ctx->cratpos[n] == pos)
+		return;
+	unindexcreature(n);
+	link = &ctx->crathead[pos];
+	while (*link >= 0 && *link < n)
+		link = &ctx->cratnext[*link];
+	ctx->cratnext[n] = *link;
+	*link = n;
+	ctx->cratpos[n] = pos;
+}
+
+/* Rebuild the index from scratch.
+ */
+static void reindexcreatures(void)
+{
+	creature   *cr;
+
+	memset(ctx->crathead, -1, sizeof ctx->crathead);
+	memset(ctx->cratpos, -1, sizeof ctx->cratpos);
+	memset(ctx->crfree, 0, sizeof ctx->crfree);
+	ctx->crfreewords = 0;
+	for (cr = creaturelist() ; cr->id ; ++cr)
+		indexcreature(cr);
+	indexcreature(cr);
+}
+
 /* Return the creature located at pos. Ignores Chip unless includechip
  * is TRUE. (This is important in the case when Chip and a second
- * creature are currently occupying a single location.)
+ * creature are currently occupying a single location.) If several
+ * creatures are present, the one earliest in the list is returned.
  */
 static creature *lookupcreature(int pos, bool includechip)
 {
-	creature   *cr;
+	int	n;
 
-	cr = creaturelist();
-	if (!includechip)
-		++cr;
-	for ( ; cr->id ; ++cr)
-		if (cr->pos == pos && !cr->hidden && !isanimation(cr->id))
-			return cr;
-	return NULL;
+	n = ctx->crathead[pos];
+	if (n == 0 && !includechip)
+		n = ctx->cratnext[n];
+	return n < 0 ? NULL : creaturelist() + n;
 }
 
-/* Return a fresh creature.
+/* Return a fresh creature. This is the first hidden creature in the
+ * list after Chip, if there is one, or else a new one at the end.
  */
 static creature *newcreature(void)
 {
 	creature   *cr;
+	int		n;
 
-	for (cr = creaturelist() + 1 ; cr->id ; ++cr) {
-		if (cr->hidden)
-			return cr;
-	}
-	if (cr - creaturelist() >= MAX_CREATURES) {
+	n = firstfreeslot();
+	if (n > 0 && creaturelist()[n].id)
+		return creaturelist() + n;
+	if (n < 0 || n >= MAX_CREATURES) {
 		warn("Ran out of room in the creatures array!");
 		return NULL;
 	}
-	if (pedanticmode && cr - creaturelist() >= PMAX_CREATURES)
+	if (pedanticmode && n >= PMAX_CREATURES)
 		return NULL;
 
+	cr = creaturelist() + n;
 	cr->hidden = true;
 	cr[1].id = Nothing;
+	indexcreature(cr + 1);
 	creaturelistend() = cr;
 	return cr;
 }
@@ -430,6 +576,7 @@ static void removecreature(creature *cr, int animationid)
 		cr->moving = 0;
 	}
 	markanimated(cr->pos);
+	indexcreature(cr);
 }
 
 /* End the given animation sequence (thus removing the final vestige
@@ -443,6 +590,7 @@ static void removeanimation(creature *cr)
 		cr->id = Nothing;
 		--creaturelistend();
 	}
+	indexcreature(cr);
 }
 
 /* Abort the animation sequence occuring at the given location.
@@ -1022,6 +1170,8 @@ static bool getforcedmove(creature *cr)
  */
 static int choosemove(creature *cr)
 {
+	PROFILE(Ruleset_Lynx, PROF_CHOOSEMOVE);
+
 	if (cr->id == Chip) {
 		choosechipmove(cr, getforcedmove(cr));
 		if (cr->tdir == NIL && getfdir(cr) == NIL)
@@ -1065,6 +1215,7 @@ static void checkmovingto(void)
  */
 static bool teleportcreature(creature *cr)
 {
+	PROFILE(Ruleset_Lynx, PROF_TELEPORT);
 	int pos, origpos;
 
 	_assert(floorat(cr->pos) == Teleport);
@@ -1079,6 +1230,7 @@ static bool teleportcreature(creature *cr)
 			if (cr->id != Chip)
 				removeclaim(cr->pos);
 			cr->pos = pos;
+			indexcreature(cr);
 			if (!islocationclaimed(pos) && canmakemove(cr, cr->dir, 0))
 				break;
 			if (pos == origpos) {
@@ -1090,8 +1242,10 @@ static bool teleportcreature(creature *cr)
 			}
 		} else if (ismarkedteleport(pos)) {
 			floorat(pos) = Teleport;
-			if (pos == chippos())
+			if (pos == chippos()) {
 				getchip()->hidden = true;
+				indexcreature(getchip());
+			}
 		}
 	}
 
@@ -1131,8 +1285,10 @@ static bool activatecloner(int pos)
 		return advancecreature(cr, true) != 0;
 
 	*clone = *cr;
+	indexcreature(clone);
 	if (advancecreature(cr, true) <= 0) {
 		clone->hidden = true;
+		indexcreature(clone);
 		return false;
 	}
 	return true;
@@ -1236,6 +1392,7 @@ static int startmovement(creature *cr, int releasing)
 	}
 
 	cr->pos += delta[dir];
+	indexcreature(cr);
 	if (cr->id != Chip)
 		claimlocation(cr->pos);
 
@@ -1386,6 +1543,7 @@ static bool endmovement(creature *cr, bool stationary)
 				break;
 			case Exit:
 				cr->hidden = true;
+				indexcreature(cr);
 				completed() = true;
 				addsoundeffect(SND_CHIP_WINS);
 				break;
@@ -1474,6 +1632,7 @@ static bool endmovement(creature *cr, bool stationary)
  */
 static int advancecreature(creature *cr, bool releasing)
 {
+	PROFILE(Ruleset_Lynx, PROF_ADVANCECREATURE);
 	char	tdir = NIL;
 
 	if (cr->moving <= 0 && !isanimation(cr->id)) {
@@ -1487,8 +1646,10 @@ static int advancecreature(creature *cr, bool releasing)
 			return +1;
 		}
 		int f = startmovement(cr, releasing);
-		if (f > 0)
+		if (f > 0) {
 			cr->hidden = false;
+			indexcreature(cr);
+		}
 		if (pedanticmode && f == 0 && !endmovement(cr, true))
 			return -1;
 		if (f < 0)
@@ -1608,8 +1769,8 @@ static void initialhousekeeping(void)
 #endif
 
 	if (currenttime() == 0) {
-		lastrndslidedir = rndslidedir();
-		laststepping = stepping();
+		ctx->lastrndslidedir = rndslidedir();
+		ctx->laststepping = stepping();
 	}
 
 	chip = getchip();
@@ -1698,6 +1859,7 @@ static void finalhousekeeping(void)
  */
 static void preparedisplay(void)
 {
+	PROFILE(Ruleset_Lynx, PROF_PREPAREDISPLAY);
 	creature   *chip;
 	int		floor;
 
@@ -1766,7 +1928,7 @@ static bool initgame(gamelogic *logic)
 
 	setstate(logic);
 	num = state->game->number;
-	creaturelist() = creaturearray + 1;
+	creaturelist() = ctx->creaturearray + 1;
 	cr = creaturelist();
 
 	if (pedanticmode)
@@ -1853,6 +2015,7 @@ static bool initgame(gamelogic *logic)
 		cr[0] = cr[n];
 		cr[n] = crtemp;
 	}
+	reindexcreatures();
 
 	for (xy = traplist(), n = traplistsize() ; n ; --n, ++xy) {
 		if (xy->from >= CXGRID * CYGRID || xy->to >= CXGRID * CYGRID) {
@@ -1880,6 +2043,7 @@ static bool initgame(gamelogic *logic)
 			xy->from = -1;
 		}
 	}
+	indexwiring();
 
 	possession(Key_Red) = possession(Key_Blue)
 		= possession(Key_Yellow)
@@ -1900,8 +2064,8 @@ static bool initgame(gamelogic *logic)
 	putwall() = -1;
 	prngvalue1() = 0;
 	prngvalue2() = 0;
-	rndslidedir() = lastrndslidedir;
-	stepping() = laststepping;
+	rndslidedir() = ctx->lastrndslidedir;
+	stepping() = ctx->laststepping;
 	xviewoffset() = 0;
 	yviewoffset() = 0;
 
@@ -1914,6 +2078,7 @@ static bool initgame(gamelogic *logic)
  */
 static int advancegame(gamelogic *logic)
 {
+	PROFILE(Ruleset_Lynx, PROF_TICK);
 	creature   *cr;
 
 	setstate(logic);
@@ -2001,33 +2166,113 @@ static bool endgame(gamelogic *logic)
 	return true;
 }
 
-/* Free all allocated resources for this module.
+/*
+ * Snapshots.
+ */
+
+/* The header of a snapshot of the engine's private data. The
+ * gamestate's pointers into the creature array are stored as offsets
+ * (or -1 for NULL), and the array itself follows the header.
+ */
+typedef struct lxsnapshot {
+	int		lastrndslidedir;
+	int		laststepping;
+	int		creatures;		/* offset of creaturelist() */
+	int		crend;			/* offset of creaturelistend() */
+	int		chiptocr;		/* offset of chiptocr() */
+} lxsnapshot;
+
+/* Translate a pointer into the creature array into an offset, and
+ * back again.
+ */
+#define	craoffset(cr)	((cr) ? (int)((cr) - ctx->creaturearray) : -1)
+#define	craentry(n)	((n) < 0 ? NULL : ctx->creaturearray + (n))
+
+/* Copy the creature array and the other values kept between ticks.
+ */
+static size_t savesnapshot(gamelogic *logic, void **data)
+{
+	lxsnapshot	       *snap;
+	size_t		size;
+
+	setstate(logic);
+	size = sizeof *snap + (MAX_CREATURES + 1) * sizeof *ctx->creaturearray;
+	x_alloc(*data, size);
+
+	snap = (lxsnapshot *)*data;
+	snap->lastrndslidedir = ctx->lastrndslidedir;
+	snap->laststepping = ctx->laststepping;
+	snap->creatures = craoffset(creaturelist());
+	snap->crend = craoffset(creaturelistend());
+	snap->chiptocr = craoffset(chiptocr());
+	memcpy(snap + 1, ctx->creaturearray,
+	       (MAX_CREATURES + 1) * sizeof *ctx->creaturearray);
+	return size;
+}
+
+/* Reinstate the creature array from a snapshot, and rebase the
+ * gamestate's pointers onto this instance's array.
+ */
+static bool restoresnapshot(gamelogic *logic, void const *data)
+{
+	lxsnapshot const       *snap;
+
+	setstate(logic);
+	snap = (lxsnapshot const *)data;
+	ctx->lastrndslidedir = snap->lastrndslidedir;
+	ctx->laststepping = snap->laststepping;
+	memcpy(ctx->creaturearray, snap + 1,
+	       (MAX_CREATURES + 1) * sizeof *ctx->creaturearray);
+	creaturelist() = craentry(snap->creatures);
+	creaturelistend() = craentry(snap->crend);
+	chiptocr() = craentry(snap->chiptocr);
+	reindexcreatures();
+	indexwiring();
+	return true;
+}
+
+/* Free all allocated resources for this instance, including the
+ * instance itself.
  */
 static void shutdown(gamelogic *logic)
 {
-	(void)logic;
-	free(creaturearray);
-	creaturearray = NULL;
+	setstate(logic);
+	free(ctx->creaturearray);
+	free(ctx);
+	free(logic);
+	state = NULL;
+	ctx = NULL;
 }
 
-/* The exported function: Initialize and return the module's gamelogic
- * structure.
+/* The exported function: Create a new instance of the engine and
+ * return its gamelogic structure. Each call yields an independent
+ * instance; the caller must attach a gamestate to it before use.
  */
 gamelogic *lynxlogicstartup(void)
 {
-	static gamelogic	logic;
+	gamelogic	       *logic;
+	lxlogiccontext	       *context;
 
-	creaturearray = (creature *)calloc(MAX_CREATURES + 1, sizeof *creaturearray);
-	if (!creaturearray)
+	logic = (gamelogic *)calloc(1, sizeof *logic);
+	context = (lxlogiccontext *)calloc(1, sizeof *context);
+	if (!logic || !context)
 		memerrexit();
-	lastrndslidedir = NORTH;
-	laststepping = 0;
-
-	logic.ruleset = Ruleset_Lynx;
-	logic.initgame = initgame;
-	logic.advancegame = advancegame;
-	logic.endgame = endgame;
-	logic.shutdown = shutdown;
-
-	return &logic;
+	context->creaturearray = (creature *)calloc(MAX_CREATURES + 1,
+						    sizeof *context->creaturearray);
+	if (!context->creaturearray)
+		memerrexit();
+	context->lastrndslidedir = NORTH;
+	context->laststepping = 0;
+
+	logic->ruleset = Ruleset_Lynx;
+	logic->state = NULL;
+	logic->context = context;
+	logic->initgame = initgame;
+	logic->advancegame = advancegame;
+	logic->endgame = endgame;
+	logic->savesnapshot = savesnapshot;
+	logic->restoresnapshot = restoresnapshot;
+	logic->shutdown = shutdown;
+
+	return logic;
 }
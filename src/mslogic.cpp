@@ -13,6 +13,7 @@
 #include	"random.h"
 #include	"logic.h"
 #include	"err.h"
+#include	"profile.h"
 
 #ifdef NDEBUG
 #define	_assert(test)	((void)0)
@@ -34,23 +35,28 @@ enum {
  */
 static bool advancecreature(creature *cr, int dir);
 
-/* The most recently used stepping phase value.
+/* The data private to one instance of the logic engine.
  */
-static int		laststepping = 0;
+typedef struct mslogiccontext mslogiccontext;
 
-/* A pointer to the game state, used so that it doesn't have to be
- * passed to every single function.
+/* Pointers to the game state and to the engine instance currently
+ * running on this thread, used so that they don't have to be passed
+ * to every single function. Each entry point rebinds them from its
+ * gamelogic argument, so any number of instances can be advanced
+ * independently (and concurrently on separate threads).
  */
-static gamestate       *state;
+static thread_local gamestate	       *state;
+static thread_local mslogiccontext     *ctx;
 
 /*
  * Accessor macros for various fields in the game state. Many of the
  * macros can be used as an lvalue.
  */
 
-#define	setstate(p)		(state = (p)->state)
+#define	setstate(p)		(state = (p)->state, \
+				 ctx = (mslogiccontext *)(p)->context)
 
-#define	getchip()		(creatures[0])
+#define	getchip()		(ctx->creatures[0])
 #define	chippos()		(getchip()->pos)
 
 #define	chipsneeded()		(state->chipsneeded)
@@ -133,7 +139,9 @@ static short *_possession(int obj)
  */
 
 /* The creature pool is a linked list of lumps, each lump holding this
- * many creatures.
+ * many creatures. Each lump is handed out from the front, so that the
+ * creature list, which is in order of allocation, walks forward
+ * through memory.
  */
 #define	crpoollumpsize	256
 
@@ -154,35 +162,48 @@ typedef	struct slipper {
 	int		dir;
 } slipper;
 
-/* The linked list of creature pools, forming the creature arena.
- */
-static crpoollump      *currentcrpoollump = NULL;
-
-/* The list of active creatures.
- */
-static creature	      **creatures = NULL;
-static int		creaturecount = 0;
-static int		creaturesallocated = 0;
-
-/* The list of "active" blocks.
- */
-static creature	      **blocks = NULL;
-static int		blockcount = 0;
-static int		blocksallocated = 0;
-
-/* The list of sliding creatures.
- */
-static slipper	       *slips = NULL;
-static int		slipcount = 0;
-static int		slipsallocated = 0;
+/* Everything that one instance of the engine keeps between calls,
+ * apart from the gamestate itself.
+ */
+struct mslogiccontext {
+	crpoollump     *currentcrpoollump;	/* the creature arena */
+	creature      **creatures;		/* the list of active creatures */
+	int		creaturecount;
+	int		creaturesallocated;
+	int		deadcreatures;		/* hidden entries in both lists */
+	creature      **blocks;			/* the list of "active" blocks */
+	int		blockcount;
+	int		blocksallocated;
+	creature      **freecreatures;		/* recycled creatures */
+	int		freecreaturecount;
+	int		freecreaturesallocated;
+	slipper	       *slips;			/* the list of sliding creatures */
+	int		slipcount;
+	int		slipsallocated;
+	int		laststepping;		/* most recent stepping value */
+	creature	dummycrlist;		/* empty list for the display */
+	short		teleports[CXGRID * CYGRID]; /* locations of teleports */
+	int		teleportcount;
+	short		switchwalls[CXGRID * CYGRID]; /* locations of toggle walls */
+	int		switchwallcount;
+	short		trapwiring[CXGRID * CYGRID];	/* trap for each button */
+	short		clonerwiring[CXGRID * CYGRID];	/* cloner for each button */
+	short		firsttrapwire[CXGRID * CYGRID];	/* first wire to a trap */
+	short		nexttrapwire[256];		/* next wire to same trap */
+	creature       *blockat[CXGRID * CYGRID];	/* block at each location */
+	short		blocksat[CXGRID * CYGRID];	/* blocks at each location */
+};
 
 /* Mark all entries in the creature arena as unused.
  */
 static void resetcreaturepool(void)
 {
-	if (currentcrpoollump)
-		while (currentcrpoollump->prev)
-			currentcrpoollump = currentcrpoollump->prev;
+	ctx->freecreaturecount = 0;
+	if (ctx->currentcrpoollump) {
+		while (ctx->currentcrpoollump->prev)
+			ctx->currentcrpoollump = ctx->currentcrpoollump->prev;
+		ctx->currentcrpoollump->count = crpoollumpsize;
+	}
 }
 
 /* Destroy the creature arena.
@@ -192,10 +213,10 @@ static void freecreaturepool(void)
 	crpoollump *next;
 
 	resetcreaturepool();
-	while (currentcrpoollump) {
-		next = currentcrpoollump->next;
-		free(currentcrpoollump);
-		currentcrpoollump = next;
+	while (ctx->currentcrpoollump) {
+		next = ctx->currentcrpoollump->next;
+		free(ctx->currentcrpoollump);
+		ctx->currentcrpoollump = next;
 	}
 }
 
@@ -206,23 +227,28 @@ static creature *allocatecreature(void)
 	crpoollump *next;
 	creature   *cr;
 
-	if (!currentcrpoollump || currentcrpoollump->count == 0) {
-		if (currentcrpoollump && currentcrpoollump->next) {
-			currentcrpoollump = currentcrpoollump->next;
-			currentcrpoollump->count = crpoollumpsize;
-		} else {
-			x_type_malloc(crpoollump, next, sizeof *next);
-			next->count = crpoollumpsize;
-			next->prev = currentcrpoollump;
-			next->next = NULL;
-			if (currentcrpoollump)
-				currentcrpoollump->next = next;
-			currentcrpoollump = next;
+	if (ctx->freecreaturecount) {
+		cr = ctx->freecreatures[--ctx->freecreaturecount];
+	} else {
+		if (!ctx->currentcrpoollump || ctx->currentcrpoollump->count == 0) {
+			if (ctx->currentcrpoollump && ctx->currentcrpoollump->next) {
+				ctx->currentcrpoollump = ctx->currentcrpoollump->next;
+				ctx->currentcrpoollump->count = crpoollumpsize;
+			} else {
+				x_type_malloc(crpoollump, next, sizeof *next);
+				next->count = crpoollumpsize;
+				next->prev = ctx->currentcrpoollump;
+				next->next = NULL;
+				if (ctx->currentcrpoollump)
+					ctx->currentcrpoollump->next = next;
+				ctx->currentcrpoollump = next;
+			}
 		}
-	}
 
-	--currentcrpoollump->count;
-	cr = currentcrpoollump->lump + currentcrpoollump->count;
+		cr = ctx->currentcrpoollump->lump + crpoollumpsize
+						  - ctx->currentcrpoollump->count;
+		--ctx->currentcrpoollump->count;
+	}
 	cr->id = Nothing;
 	cr->pos = -1;
 	cr->dir = NIL;
@@ -238,18 +264,21 @@ static creature *allocatecreature(void)
  */
 static void resetcreaturelist(void)
 {
-	creaturecount = 0;
+	ctx->creaturecount = 0;
+	ctx->deadcreatures = 0;
 }
 
 /* Append the given creature to the end of the creature list.
  */
 static creature *addtocreaturelist(creature *cr)
 {
-	if (creaturecount >= creaturesallocated) {
-		creaturesallocated = creaturesallocated ? creaturesallocated * 2 : 16;
-		x_type_alloc(creature *, creatures, creaturesallocated * sizeof *creatures);
+	if (ctx->creaturecount >= ctx->creaturesallocated) {
+		ctx->creaturesallocated = ctx->creaturesallocated ? ctx->creaturesallocated * 2 : 16;
+		x_type_alloc(creature *, ctx->creatures, ctx->creaturesallocated * sizeof *ctx->creatures);
 	}
-	creatures[creaturecount++] = cr;
+	ctx->creatures[ctx->creaturecount++] = cr;
+	if (cr->hidden)
+		++ctx->deadcreatures;
 	return cr;
 }
 
@@ -257,26 +286,74 @@ static creature *addtocreaturelist(creature *cr)
  */
 static void resetblocklist(void)
 {
-	blockcount = 0;
+	ctx->blockcount = 0;
+	memset(ctx->blocksat, 0, sizeof ctx->blocksat);
+}
+
+/* Add a block to the count of blocks at its location. Hidden blocks
+ * are not counted.
+ */
+static void placeblock(creature *cr)
+{
+	if (cr->hidden)
+		return;
+	if (!ctx->blocksat[cr->pos]++)
+		ctx->blockat[cr->pos] = cr;
+}
+
+/* Remove a block from the count of blocks at its location. If exactly
+ * one other block remains there, it is found in the list.
+ */
+static void unplaceblock(creature *cr)
+{
+	int	n;
+
+	if (cr->hidden)
+		return;
+	if (--ctx->blocksat[cr->pos] != 1)
+		return;
+	for (n = 0 ; n < ctx->blockcount ; ++n) {
+		if (ctx->blocks[n] != cr && ctx->blocks[n]->pos == cr->pos
+					 && !ctx->blocks[n]->hidden) {
+			ctx->blockat[cr->pos] = ctx->blocks[n];
+			break;
+		}
+	}
 }
 
 /* Append the given block to the end of the block list.
  */
 static creature *addtoblocklist(creature *cr)
 {
-	if (blockcount >= blocksallocated) {
-		blocksallocated = blocksallocated ? blocksallocated * 2 : 16;
-		x_type_alloc(creature *, blocks, blocksallocated * sizeof *blocks);
+	if (ctx->blockcount >= ctx->blocksallocated) {
+		ctx->blocksallocated = ctx->blocksallocated ? ctx->blocksallocated * 2 : 16;
+		x_type_alloc(creature *, ctx->blocks, ctx->blocksallocated * sizeof *ctx->blocks);
 	}
-	blocks[blockcount++] = cr;
+	ctx->blocks[ctx->blockcount++] = cr;
+	if (cr->hidden)
+		++ctx->deadcreatures;
+	else
+		placeblock(cr);
 	return cr;
 }
 
+/* Return the given creature to the arena, to be handed out again by
+ * allocatecreature().
+ */
+static void freecreature(creature *cr)
+{
+	if (ctx->freecreaturecount >= ctx->freecreaturesallocated) {
+		ctx->freecreaturesallocated = ctx->freecreaturesallocated ? ctx->freecreaturesallocated * 2 : 16;
+		x_type_alloc(creature *, ctx->freecreatures, ctx->freecreaturesallocated * sizeof *ctx->freecreatures);
+	}
+	ctx->freecreatures[ctx->freecreaturecount++] = cr;
+}
+
 /* Empty the list of sliding creatures.
  */
 static void resetsliplist(void)
 {
-	slipcount = 0;
+	ctx->slipcount = 0;
 }
 
 /* Append the given creature to the end of the slip list.
@@ -285,20 +362,20 @@ static creature *appendtosliplist(creature *cr, int dir)
 {
 	int	n;
 
-	for (n = 0 ; n < slipcount ; ++n) {
-		if (slips[n].cr == cr) {
-			slips[n].dir = dir;
+	for (n = 0 ; n < ctx->slipcount ; ++n) {
+		if (ctx->slips[n].cr == cr) {
+			ctx->slips[n].dir = dir;
 			return cr;
 		}
 	}
 
-	if (slipcount >= slipsallocated) {
-		slipsallocated = slipsallocated ? slipsallocated * 2 : 16;
-		x_type_alloc(slipper, slips, slipsallocated * sizeof *slips);
+	if (ctx->slipcount >= ctx->slipsallocated) {
+		ctx->slipsallocated = ctx->slipsallocated ? ctx->slipsallocated * 2 : 16;
+		x_type_alloc(slipper, ctx->slips, ctx->slipsallocated * sizeof *ctx->slips);
 	}
-	slips[slipcount].cr = cr;
-	slips[slipcount].dir = dir;
-	++slipcount;
+	ctx->slips[ctx->slipcount].cr = cr;
+	ctx->slips[ctx->slipcount].dir = dir;
+	++ctx->slipcount;
 	return cr;
 }
 
@@ -308,20 +385,20 @@ static creature *prependtosliplist(creature *cr, int dir)
 {
 	int	n;
 
-	if (slipcount && slips[0].cr == cr) {
-		slips[0].dir = dir;
+	if (ctx->slipcount && ctx->slips[0].cr == cr) {
+		ctx->slips[0].dir = dir;
 		return cr;
 	}
 
-	if (slipcount >= slipsallocated) {
-		slipsallocated = slipsallocated ? slipsallocated * 2 : 16;
-		x_type_alloc(slipper, slips, slipsallocated * sizeof *slips);
+	if (ctx->slipcount >= ctx->slipsallocated) {
+		ctx->slipsallocated = ctx->slipsallocated ? ctx->slipsallocated * 2 : 16;
+		x_type_alloc(slipper, ctx->slips, ctx->slipsallocated * sizeof *ctx->slips);
 	}
-	for (n = slipcount ; n ; --n)
-		slips[n] = slips[n - 1];
-	++slipcount;
-	slips[0].cr = cr;
-	slips[0].dir = dir;
+	for (n = ctx->slipcount ; n ; --n)
+		ctx->slips[n] = ctx->slips[n - 1];
+	++ctx->slipcount;
+	ctx->slips[0].cr = cr;
+	ctx->slips[0].dir = dir;
 	return cr;
 }
 
@@ -329,9 +406,9 @@ static creature *prependtosliplist(creature *cr, int dir)
  */
 static int getslipdir(const creature *cr)
 {
-	for (int n = 0 ; n < slipcount ; ++n)
-		if (slips[n].cr == cr)
-			return slips[n].dir;
+	for (int n = 0 ; n < ctx->slipcount ; ++n)
+		if (ctx->slips[n].cr == cr)
+			return ctx->slips[n].dir;
 	return NIL;
 }
 
@@ -341,14 +418,14 @@ static void removefromsliplist(creature *cr)
 {
 	int	n;
 
-	for (n = 0 ; n < slipcount ; ++n)
-		if (slips[n].cr == cr)
+	for (n = 0 ; n < ctx->slipcount ; ++n)
+		if (ctx->slips[n].cr == cr)
 			break;
-	if (n == slipcount)
+	if (n == ctx->slipcount)
 		return;
-	--slipcount;
-	for ( ; n < slipcount ; ++n)
-		slips[n] = slips[n + 1];
+	--ctx->slipcount;
+	for ( ; n < ctx->slipcount ; ++n)
+		ctx->slips[n] = ctx->slips[n + 1];
 }
 
 /*
@@ -395,32 +472,50 @@ static int icewallturn(int floor, int dir)
 	return dir;
 }
 
+/* Index the level's trap and cloner wiring by location. For each
+ * button, the first connection listed for it is the one that counts.
+ * The wires leading to each trap are chained together through
+ * nexttrapwire, in list order. The wiring never changes during play,
+ * so this only needs to be done when the level is set up.
+ */
+static void indexwiring(void)
+{
+	xyconn     *xy;
+	int		n;
+
+	memset(ctx->trapwiring, -1, sizeof ctx->trapwiring);
+	memset(ctx->clonerwiring, -1, sizeof ctx->clonerwiring);
+	memset(ctx->firsttrapwire, -1, sizeof ctx->firsttrapwire);
+	for (n = traplistsize() - 1, xy = traplist() + n ; n >= 0 ; --n, --xy) {
+		if (xy->from >= 0 && xy->from < CXGRID * CYGRID)
+			ctx->trapwiring[xy->from] = xy->to;
+		ctx->nexttrapwire[n] = -1;
+		if (xy->to >= 0 && xy->to < CXGRID * CYGRID) {
+			ctx->nexttrapwire[n] = ctx->firsttrapwire[xy->to];
+			ctx->firsttrapwire[xy->to] = n;
+		}
+	}
+	for (n = clonerlistsize() - 1, xy = clonerlist() + n ; n >= 0 ; --n, --xy)
+		if (xy->from >= 0 && xy->from < CXGRID * CYGRID)
+			ctx->clonerwiring[xy->from] = xy->to;
+}
+
 /* Find the location of a bear trap from one of its buttons.
  */
 static int trapfrombutton(int pos)
 {
-	xyconn     *traps;
-	int		i;
-
-	traps = traplist();
-	for (i = traplistsize() ; i ; ++traps, --i)
-		if (traps->from == pos)
-			return traps->to;
-	return -1;
+	if (pos < 0 || pos >= CXGRID * CYGRID)
+		return -1;
+	return ctx->trapwiring[pos];
 }
 
 /* Find the location of a clone machine from one of its buttons.
  */
 static int clonerfrombutton(int pos)
 {
-	xyconn     *cloners;
-	int		i;
-
-	cloners = clonerlist();
-	for (i = clonerlistsize() ; i ; ++cloners, --i)
-		if (cloners->from == pos)
-			return cloners->to;
-	return -1;
+	if (pos < 0 || pos >= CXGRID * CYGRID)
+		return -1;
+	return ctx->clonerwiring[pos];
 }
 
 /* Return the floor tile found at the given location.
@@ -501,9 +596,8 @@ static bool istrapopen(int pos, int skippos)
 	int		i;
 
 	traps = traplist();
-	for (i = traplistsize() ; i ; ++traps, --i)
-		if (traps->to == pos && traps->from != skippos
-			&& istrapbuttondown(traps->from))
+	for (i = ctx->firsttrapwire[pos] ; i >= 0 ; i = ctx->nexttrapwire[i])
+		if (traps[i].from != skippos && istrapbuttondown(traps[i].from))
 			return true;
 	return false;
 }
@@ -513,10 +607,10 @@ static bool istrapopen(int pos, int skippos)
 static void togglewalls(void)
 {
 	mapcell    *cell;
-	int		pos;
+	int		n;
 
-	for (pos = 0 ; pos < CXGRID * CYGRID ; ++pos) {
-		cell = cellat(pos);
+	for (n = 0 ; n < ctx->switchwallcount ; ++n) {
+		cell = cellat(ctx->switchwalls[n]);
 		if ((cell->top.id == SwitchWall_Open
 				|| cell->top.id == SwitchWall_Closed)
 			&& !(cell->top.state & FS_BROKEN))
@@ -550,14 +644,14 @@ static creature *lookupcreature(int pos, bool includechip)
 {
 	int	n;
 
-	if (!creatures)
+	if (!ctx->creatures)
 		return NULL;
-	for (n = 0 ; n < creaturecount ; ++n) {
-		if (creatures[n]->hidden)
+	for (n = 0 ; n < ctx->creaturecount ; ++n) {
+		if (ctx->creatures[n]->hidden)
 			continue;
-		if (creatures[n]->pos == pos)
-			if (creatures[n]->id != Chip || includechip)
-				return creatures[n];
+		if (ctx->creatures[n]->pos == pos)
+			if (ctx->creatures[n]->id != Chip || includechip)
+				return ctx->creatures[n];
 	}
 	return NULL;
 }
@@ -569,10 +663,12 @@ static creature *lookupblock(int pos)
 {
 	creature   *cr;
 
-	if (blocks) {
-		for (int n = 0 ; n < blockcount ; ++n)
-			if (blocks[n]->pos == pos && !blocks[n]->hidden)
-				return blocks[n];
+	if (ctx->blocksat[pos] == 1)
+		return ctx->blockat[pos];
+	if (ctx->blocksat[pos]) {
+		for (int n = 0 ; n < ctx->blockcount ; ++n)
+			if (ctx->blocks[n]->pos == pos && !ctx->blocks[n]->hidden)
+				return ctx->blocks[n];
 	}
 
 	cr = allocatecreature();
@@ -662,8 +758,14 @@ static void removecreature(creature *cr)
 	if (cr->id == Chip) {
 		if (chipstatus() == CHIP_OKAY)
 			chipstatus() = CHIP_NOTOKAY;
-	} else
+	} else {
+		if (!cr->hidden) {
+			if (cr->id == Block)
+				unplaceblock(cr);
+			++ctx->deadcreatures;
+		}
 		cr->hidden = true;
+	}
 }
 
 /* Turn around any and all tanks. (A tank that is halfway through the
@@ -673,22 +775,22 @@ static void turntanks(creature const *inmidmove)
 {
 	int	n;
 
-	for (n = 0 ; n < creaturecount ; ++n) {
-		if (creatures[n]->hidden || creatures[n]->id != Tank)
+	for (n = 0 ; n < ctx->creaturecount ; ++n) {
+		if (ctx->creatures[n]->hidden || ctx->creatures[n]->id != Tank)
 			continue;
-		creatures[n]->dir = back(creatures[n]->dir);
-		if (!(creatures[n]->state & CS_TURNING))
-			creatures[n]->state |= CS_TURNING | CS_HASMOVED;
-		if (creatures[n] != inmidmove) {
-			if (creatureid(cellat(creatures[n]->pos)->top.id) == Tank) {
-				updatecreature(creatures[n]);
+		ctx->creatures[n]->dir = back(ctx->creatures[n]->dir);
+		if (!(ctx->creatures[n]->state & CS_TURNING))
+			ctx->creatures[n]->state |= CS_TURNING | CS_HASMOVED;
+		if (ctx->creatures[n] != inmidmove) {
+			if (creatureid(cellat(ctx->creatures[n]->pos)->top.id) == Tank) {
+				updatecreature(ctx->creatures[n]);
 			} else {
-				if (creatures[n]->state & CS_TURNING) {
-					creatures[n]->state &= ~CS_TURNING;
-					updatecreature(creatures[n]);
-					creatures[n]->state |= CS_TURNING;
+				if (ctx->creatures[n]->state & CS_TURNING) {
+					ctx->creatures[n]->state &= ~CS_TURNING;
+					updatecreature(ctx->creatures[n]);
+					ctx->creatures[n]->state |= CS_TURNING;
 				}
-				creatures[n]->dir = back(creatures[n]->dir);
+				ctx->creatures[n]->dir = back(ctx->creatures[n]->dir);
 			}
 		}
 	}
@@ -741,11 +843,12 @@ static void endfloormovement(creature *cr)
  */
 static void updatesliplist()
 {
+	PROFILE(Ruleset_MS, PROF_SLIPS);
 	int	n;
 
-	for (n = slipcount - 1 ; n >= 0 ; --n)
-		if (!(slips[n].cr->state & (CS_SLIP | CS_SLIDE)))
-			endfloormovement(slips[n].cr);
+	for (n = ctx->slipcount - 1 ; n >= 0 ; --n)
+		if (!(ctx->slips[n].cr->state & (CS_SLIP | CS_SLIDE)))
+			endfloormovement(ctx->slips[n].cr);
 }
 
 /*
@@ -1266,13 +1369,49 @@ static void choosechipmove(creature *cr, int discard)
 	cr->tdir = dir;
 }
 
+/* Record the locations of all teleports on the map, in reading order.
+ * Since teleports are never created during play, the list only needs
+ * to be made when the map is set up. A teleport can be covered up or
+ * broken, however, so teleportcreature() still checks each location.
+ */
+static void findteleports(void)
+{
+	mapcell    *cell;
+	int		pos;
+
+	ctx->teleportcount = 0;
+	for (pos = 0, cell = state->map ; pos < CXGRID * CYGRID ; ++pos, ++cell)
+		if (cell->top.id == Teleport || cell->bot.id == Teleport)
+			ctx->teleports[ctx->teleportcount++] = pos;
+}
+
+/* Record the locations of all toggle walls on the map. As with
+ * teleports, they are never created during play, and a toggle wall
+ * only ever moves between the two layers of its own cell, so the list
+ * only needs to be made when the map is set up.
+ */
+static void findswitchwalls(void)
+{
+	mapcell    *cell;
+	int		pos;
+
+	ctx->switchwallcount = 0;
+	for (pos = 0, cell = state->map ; pos < CXGRID * CYGRID ; ++pos, ++cell)
+		if (cell->top.id == SwitchWall_Open
+				|| cell->top.id == SwitchWall_Closed
+				|| cell->bot.id == SwitchWall_Open
+				|| cell->bot.id == SwitchWall_Closed)
+			ctx->switchwalls[ctx->switchwallcount++] = pos;
+}
+
 /* Teleport the given creature instantaneously from the teleport tile
  * at start to another teleport tile (if possible).
  */
 static int teleportcreature(creature *cr, int start)
 {
+	PROFILE(Ruleset_MS, PROF_TELEPORT);
 	maptile    *tile;
-	int		dest, origpos, f;
+	int		dest, origpos, f, n, i;
 
 	_assert(!cr->hidden);
 	if (cr->dir == NIL) {
@@ -1282,34 +1421,43 @@ static int teleportcreature(creature *cr, int start)
 	}
 
 	origpos = cr->pos;
-	dest = start;
 
-	for (;;) {
-		--dest;
-		if (dest < 0)
-			dest += CXGRID * CYGRID;
+	for (n = 0 ; n < ctx->teleportcount && ctx->teleports[n] < start ; ++n) ;
+	for (i = ctx->teleportcount ; i ; --i) {
+		n = (n ? n : ctx->teleportcount) - 1;
+		dest = ctx->teleports[n];
 		if (dest == start)
 			break;
 		tile = &cellat(dest)->top;
 		if (tile->id != Teleport || (tile->state & FS_BROKEN))
 			continue;
+		if (cr->id == Block)
+			unplaceblock(cr);
 		cr->pos = dest;
+		if (cr->id == Block)
+			placeblock(cr);
 		f = canmakemove(cr, cr->dir, CMM_NOLEAVECHECK | CMM_NOEXPOSEWALLS
 						| CMM_NODEFERBUTTONS
 						| CMM_NOFIRECHECK
 						| CMM_TELEPORTPUSH);
+		if (cr->id == Block)
+			unplaceblock(cr);
 		cr->pos = origpos;
+		if (cr->id == Block)
+			placeblock(cr);
 		if (f)
-			break;
+			return dest;
 	}
 
-	return dest;
+	return start;
 }
 
 /* Determine the move(s) a creature will make on the current tick.
  */
 static void choosemove(creature *cr)
 {
+	PROFILE(Ruleset_MS, PROF_CHOOSEMOVE);
+
 	if (cr->id == Chip) {
 		choosechipmove(cr, cr->state & CS_SLIP);
 	} else {
@@ -1675,7 +1823,11 @@ static void endmovement(creature *cr, int dir)
 			break;
 	}
 
+	if (cr->id == Block)
+		unplaceblock(cr);
 	cr->pos = newpos;
+	if (cr->id == Block)
+		placeblock(cr);
 
 	if (cellat(oldpos)->bot.id == CloneMachine)
 		cellat(oldpos)->bot.state &= ~FS_CLONING;
@@ -1684,12 +1836,8 @@ static void endmovement(creature *cr, int dir)
 		if (istrapopen(newpos, oldpos))
 			cr->state |= CS_RELEASED;
 	} else if (cellat(newpos)->bot.id == Beartrap) {
-		for (i = 0 ; i < traplistsize() ; ++i) {
-			if (traplist()[i].to == newpos) {
-				cr->state |= CS_RELEASED;
-				break;
-			}
-		}
+		if (ctx->firsttrapwire[newpos] >= 0)
+			cr->state |= CS_RELEASED;
 	}
 
 	if (cr->id == Chip) {
@@ -1734,6 +1882,8 @@ static void endmovement(creature *cr, int dir)
  */
 static bool advancecreature(creature *cr, int dir)
 {
+	PROFILE(Ruleset_MS, PROF_ADVANCECREATURE);
+
 	if (dir == NIL)
 		return true;
 
@@ -1760,6 +1910,8 @@ static bool advancecreature(creature *cr, int dir)
  */
 static int checkforending(void)
 {
+	PROFILE(Ruleset_MS, PROF_CHECKFORENDING);
+
 	if (chipstatus() != CHIP_OKAY) {
 		addsoundeffect(SND_CHIP_LOSES);
 		return -1;
@@ -1781,15 +1933,16 @@ static int checkforending(void)
  */
 static void floormovements(void)
 {
+	PROFILE(Ruleset_MS, PROF_SLIPS);
 	creature   *cr;
 	int		floor, slipdir;
 
-	for (int n = 0 ; n < slipcount ; ++n) {
-		int savedcount = slipcount;
-		cr = slips[n].cr;
-		if (!(slips[n].cr->state & (CS_SLIP | CS_SLIDE)))
+	for (int n = 0 ; n < ctx->slipcount ; ++n) {
+		int savedcount = ctx->slipcount;
+		cr = ctx->slips[n].cr;
+		if (!(ctx->slips[n].cr->state & (CS_SLIP | CS_SLIDE)))
 			continue;
-		slipdir = slips[n].dir;
+		slipdir = ctx->slips[n].dir;
 		if (slipdir == NIL)
 			continue;
 		if (cr->id == Chip)
@@ -1824,7 +1977,7 @@ static void floormovements(void)
 		if (checkforending())
 			return;
 		if (!(cr->state & (CS_SLIP | CS_SLIDE)) && cr->id != Chip
-			&& slipcount == savedcount + 1)
+			&& ctx->slipcount == savedcount + 1)
 			++n;
 	}
 }
@@ -1833,9 +1986,9 @@ static void createclones(void)
 {
 	int	n;
 
-	for (n = 0 ; n < creaturecount ; ++n)
-		if (creatures[n]->state & CS_CLONING)
-			creatures[n]->state &= ~CS_CLONING;
+	for (n = 0 ; n < ctx->creaturecount ; ++n)
+		if (ctx->creatures[n]->state & CS_CLONING)
+			ctx->creatures[n]->state &= ~CS_CLONING;
 }
 
 #ifndef NDEBUG
@@ -1861,13 +2014,13 @@ static void dumpmap(void)
 		fputc('\n', stderr);
 	}
 	fputc('\n', stderr);
-	for (y = 0 ; y < creaturecount ; ++y) {
-		cr = creatures[y];
+	for (y = 0 ; y < ctx->creaturecount ; ++y) {
+		cr = ctx->creatures[y];
 		fprintf(stderr, "%02X%c (%d %d)",
 			cr->id, "-^<?v?\?\?>"[(int)cr->dir],
 			cr->pos % CXGRID, cr->pos / CXGRID);
-		for (x = 0 ; x < slipcount ; ++x) {
-			if (cr == slips[x].cr) {
+		for (x = 0 ; x < ctx->slipcount ; ++x) {
+			if (cr == ctx->slips[x].cr) {
 				fprintf(stderr, " [%d]", x + 1);
 				break;
 			}
@@ -1882,17 +2035,17 @@ static void dumpmap(void)
 			(cr->state & CS_SLIDE) ? " sliding" : "",
 			(cr->state & CS_DEFERPUSH) ? " deferred-push" : "",
 			(cr->state & CS_MUTANT) ? " mutant" : "");
-		if (x < slipcount)
-			fprintf(stderr, " %c", "-^<?v?\?\?>"[(int)slips[x].dir]);
+		if (x < ctx->slipcount)
+			fprintf(stderr, " %c", "-^<?v?\?\?>"[(int)ctx->slips[x].dir]);
 		fputc('\n', stderr);
 	}
-	for (y = 0 ; y < blockcount ; ++y) {
-		cr = blocks[y];
+	for (y = 0 ; y < ctx->blockcount ; ++y) {
+		cr = ctx->blocks[y];
 		fprintf(stderr, "block %d: (%d %d) %c", y,
 			cr->pos % CXGRID, cr->pos / CXGRID,
 			"-^<?v?\?\?>"[(int)cr->dir]);
-		for (x = 0 ; x < slipcount ; ++x) {
-			if (cr == slips[x].cr) {
+		for (x = 0 ; x < ctx->slipcount ; ++x) {
+			if (cr == ctx->slips[x].cr) {
 				fprintf(stderr, " [%d]", x + 1);
 				break;
 			}
@@ -1907,8 +2060,8 @@ static void dumpmap(void)
 			(cr->state & CS_SLIDE) ? " sliding" : "",
 			(cr->state & CS_DEFERPUSH) ? " deferred-push" : "",
 			(cr->state & CS_MUTANT) ? " mutant" : "");
-		if (x < slipcount)
-			fprintf(stderr, " %c", "-^<?v?\?\?>"[(int)slips[x].dir]);
+		if (x < ctx->slipcount)
+			fprintf(stderr, " %c", "-^<?v?\?\?>"[(int)ctx->slips[x].dir]);
 		fputc('\n', stderr);
 	}
 }
@@ -1920,8 +2073,8 @@ static void verifymap(void)
 	creature   *cr;
 	int		n;
 
-	for (n = 0 ; n < creaturecount ; ++n) {
-		cr = creatures[n];
+	for (n = 0 ; n < ctx->creaturecount ; ++n) {
+		cr = ctx->creatures[n];
 		if (cr->id < 0x40 || cr->id >= 0x80)
 			warn("%d: Undefined creature %02X at (%d %d)",
 				state->currenttime, cr->id,
@@ -1980,13 +2133,13 @@ static void initialhousekeeping(void)
 #endif
 
 	if (currenttime() == 0)
-		laststepping = stepping();
+		ctx->laststepping = stepping();
 
 	if (!(currenttime() & 3)) {
-		for (int n = 1 ; n < creaturecount ; ++n) {
-			if (creatures[n]->state & CS_TURNING) {
-				creatures[n]->state &= ~(CS_TURNING | CS_HASMOVED);
-				updatecreature(creatures[n]);
+		for (int n = 1 ; n < ctx->creaturecount ; ++n) {
+			if (ctx->creatures[n]->state & CS_TURNING) {
+				ctx->creatures[n]->state &= ~(CS_TURNING | CS_HASMOVED);
+				updatecreature(ctx->creatures[n]);
 			}
 		}
 		++chipwait();
@@ -1998,15 +2151,50 @@ static void initialhousekeeping(void)
 	}
 }
 
-/* Actions and checks that occur at the end of a tick.
+/* Remove the creatures that have died from the given list, keeping
+ * the others in order, and return them to the arena. A creature still
+ * waiting to leave the slip list is kept until the next tick. The new
+ * length of the list is returned.
+ */
+static int dropdeadcreatures(creature **list, int count)
+{
+	creature   *cr;
+	int		i, n, x;
+
+	for (i = n = 0 ; i < count ; ++i) {
+		cr = list[i];
+		if (cr->hidden) {
+			for (x = 0 ; x < ctx->slipcount ; ++x)
+				if (ctx->slips[x].cr == cr)
+					break;
+			if (x == ctx->slipcount) {
+				freecreature(cr);
+				continue;
+			}
+			++ctx->deadcreatures;
+		}
+		list[n++] = cr;
+	}
+	return n;
+}
+
+/* Actions and checks that occur at the end of a tick. Creatures and
+ * blocks that have died are dropped from their lists, so that the
+ * per-tick loops only visit the living.
  */
 static void finalhousekeeping(void)
 {
-	return;
+	if (!ctx->deadcreatures)
+		return;
+	ctx->deadcreatures = 0;
+	ctx->creaturecount = dropdeadcreatures(ctx->creatures,
+					       ctx->creaturecount);
+	ctx->blockcount = dropdeadcreatures(ctx->blocks, ctx->blockcount);
 }
 
 static void preparedisplay(void)
 {
+	PROFILE(Ruleset_MS, PROF_PREPAREDISPLAY);
 	int	pos;
 
 	pos = chippos();
@@ -2031,7 +2219,6 @@ static void preparedisplay(void)
  */
 static bool initgame(gamelogic *logic)
 {
-	static creature	dummycrlist;
 	mapcell	       *cell;
 	xyconn	       *xy;
 	creature	       *cr;
@@ -2050,6 +2237,9 @@ static bool initgame(gamelogic *logic)
 				|| cell->bot.id == SwitchWall_Closed)
 				cell->bot.state |= FS_BROKEN;
 	}
+	findteleports();
+	findswitchwalls();
+	indexwiring();
 
 	chip = allocatecreature();
 	chip->pos = 0;
@@ -2093,8 +2283,8 @@ static bool initgame(gamelogic *logic)
 		}
 	}
 
-	dummycrlist.id = 0;
-	state->creatures = &dummycrlist;
+	ctx->dummycrlist.id = 0;
+	state->creatures = &ctx->dummycrlist;
 	state->initrndslidedir = NORTH;
 
 	possession(Key_Red) = possession(Key_Blue)
@@ -2115,7 +2305,7 @@ static bool initgame(gamelogic *logic)
 	chipstatus() = CHIP_OKAY;
 	controllerdir() = NIL;
 	lastslipdir() = NIL;
-	stepping() = laststepping;
+	stepping() = ctx->laststepping;
 	cancelgoal();
 	xviewoffset() = 0;
 	yviewoffset() = 0;
@@ -2128,6 +2318,7 @@ static bool initgame(gamelogic *logic)
  */
 static int advancegame(gamelogic *logic)
 {
+	PROFILE(Ruleset_MS, PROF_TICK);
 	creature   *cr;
 	int		r = 0;
 	int		n;
@@ -2139,8 +2330,8 @@ static int advancegame(gamelogic *logic)
 
 	if (currenttime() && !(currenttime() & 1)) {
 		controllerdir() = NIL;
-		for (n = 0 ; n < creaturecount ; ++n) {
-			cr = creatures[n];
+		for (n = 0 ; n < ctx->creaturecount ; ++n) {
+			cr = ctx->creatures[n];
 			if (cr->hidden || (cr->state & CS_CLONING) || cr->id == Chip)
 				continue;
 			choosemove(cr);
@@ -2190,7 +2381,7 @@ done:
  */
 static bool endgame(gamelogic *logic)
 {
-	(void)logic;
+	setstate(logic);
 	resetcreaturepool();
 	resetcreaturelist();
 	resetblocklist();
@@ -2198,40 +2389,208 @@ static bool endgame(gamelogic *logic)
 	return true;
 }
 
-/* Free all allocated resources for this module.
+/*
+ * Snapshots.
+ */
+
+/* The header of a snapshot of the engine's private data. It is
+ * followed by the count of each lump in the creature pool up to the
+ * current one, the creature, block, and slip lists (with each
+ * creature pointer replaced by its index in the pool, and each slip
+ * entry followed by its direction), and finally the lumps' contents.
+ */
+typedef struct mssnapshot {
+	int		lumpcount;		/* number of lumps in use */
+	int		creaturecount;
+	int		blockcount;
+	int		slipcount;
+	int		laststepping;
+} mssnapshot;
+
+/* Return the first lump of the creature arena.
+ */
+static crpoollump *firstcrpoollump(void)
+{
+	crpoollump *lump;
+
+	lump = ctx->currentcrpoollump;
+	if (lump)
+		while (lump->prev)
+			lump = lump->prev;
+	return lump;
+}
+
+/* Translate a creature into its position in the arena.
+ */
+static int crpoolindex(creature const *cr)
+{
+	crpoollump *lump;
+	int		n;
+
+	for (n = 0, lump = firstcrpoollump() ; lump ; ++n, lump = lump->next)
+		if (cr >= lump->lump && cr < lump->lump + crpoollumpsize)
+			return n * crpoollumpsize + (int)(cr - lump->lump);
+	_assert(!"creature is not in the arena");
+	return -1;
+}
+
+/* Translate a position in the arena back into a creature.
+ */
+static creature *crpoolentry(int index)
+{
+	crpoollump *lump;
+	int		n;
+
+	lump = firstcrpoollump();
+	for (n = index / crpoollumpsize ; n ; --n)
+		lump = lump->next;
+	return lump->lump + index % crpoollumpsize;
+}
+
+/* Copy the creature arena and the lists that point into it.
+ */
+static size_t savesnapshot(gamelogic *logic, void **data)
+{
+	mssnapshot	       *snap;
+	crpoollump	       *lump;
+	creature	       *crs;
+	int		       *p;
+	size_t		size;
+	int			n;
+
+	setstate(logic);
+
+	n = 0;
+	if (ctx->currentcrpoollump)
+		for (lump = firstcrpoollump() ; lump != ctx->currentcrpoollump->next
+					      ; lump = lump->next)
+			++n;
+	size = sizeof *snap
+	     + (n + ctx->creaturecount + ctx->blockcount + 2 * ctx->slipcount)
+		* sizeof *p
+	     + n * crpoollumpsize * sizeof *crs;
+	x_alloc(*data, size);
+
+	snap = (mssnapshot *)*data;
+	snap->lumpcount = n;
+	snap->creaturecount = ctx->creaturecount;
+	snap->blockcount = ctx->blockcount;
+	snap->slipcount = ctx->slipcount;
+	snap->laststepping = ctx->laststepping;
+
+	p = (int *)(snap + 1);
+	for (n = 0, lump = firstcrpoollump() ; n < snap->lumpcount
+					     ; ++n, lump = lump->next)
+		*p++ = lump->count;
+	for (n = 0 ; n < ctx->creaturecount ; ++n)
+		*p++ = crpoolindex(ctx->creatures[n]);
+	for (n = 0 ; n < ctx->blockcount ; ++n)
+		*p++ = crpoolindex(ctx->blocks[n]);
+	for (n = 0 ; n < ctx->slipcount ; ++n) {
+		*p++ = crpoolindex(ctx->slips[n].cr);
+		*p++ = ctx->slips[n].dir;
+	}
+	crs = (creature *)p;
+	for (n = 0, lump = firstcrpoollump() ; n < snap->lumpcount
+					     ; ++n, lump = lump->next)
+		memcpy(crs + n * crpoollumpsize, lump->lump, sizeof lump->lump);
+
+	return size;
+}
+
+/* Reinstate the creature arena and its lists from a snapshot, adding
+ * lumps to the arena if it is smaller than the one copied.
+ */
+static bool restoresnapshot(gamelogic *logic, void const *data)
+{
+	mssnapshot const       *snap;
+	crpoollump	       *lump;
+	creature const	       *crs;
+	int const	       *p;
+	int			n;
+
+	setstate(logic);
+	snap = (mssnapshot const *)data;
+	p = (int const *)(snap + 1);
+	crs = (creature const *)(p + snap->lumpcount + snap->creaturecount
+				   + snap->blockcount + 2 * snap->slipcount);
+
+	resetcreaturepool();
+	for (n = 0 ; n < snap->lumpcount ; ++n) {
+		lump = n ? ctx->currentcrpoollump->next : ctx->currentcrpoollump;
+		if (!lump) {
+			x_type_malloc(crpoollump, lump, sizeof *lump);
+			lump->prev = n ? ctx->currentcrpoollump : NULL;
+			lump->next = NULL;
+			if (n)
+				ctx->currentcrpoollump->next = lump;
+		}
+		ctx->currentcrpoollump = lump;
+		lump->count = *p++;
+		memcpy(lump->lump, crs + n * crpoollumpsize, sizeof lump->lump);
+	}
+
+	resetcreaturelist();
+	for (n = 0 ; n < snap->creaturecount ; ++n)
+		addtocreaturelist(crpoolentry(*p++));
+	resetblocklist();
+	for (n = 0 ; n < snap->blockcount ; ++n)
+		addtoblocklist(crpoolentry(*p++));
+	resetsliplist();
+	for (n = 0 ; n < snap->slipcount ; ++n, p += 2)
+		appendtosliplist(crpoolentry(p[0]), p[1]);
+	ctx->laststepping = snap->laststepping;
+	findteleports();
+	findswitchwalls();
+	indexwiring();
+
+	ctx->dummycrlist.id = 0;
+	state->creatures = &ctx->dummycrlist;
+	return true;
+}
+
+/* Free all allocated resources for this instance, including the
+ * instance itself.
  */
 static void shutdown(gamelogic *logic)
 {
-	(void)logic;
-
-	free(creatures);
-	creatures = NULL;
-	creaturecount = 0;
-	creaturesallocated = 0;
-	free(blocks);
-	blocks = NULL;
-	blockcount = 0;
-	blocksallocated = 0;
-	free(slips);
-	slips = NULL;
-	slipcount = 0;
-	slipsallocated = 0;
+	setstate(logic);
 
+	free(ctx->creatures);
+	free(ctx->blocks);
+	free(ctx->slips);
+	free(ctx->freecreatures);
 	freecreaturepool();
+
+	free(ctx);
+	free(logic);
+	state = NULL;
+	ctx = NULL;
 }
 
-/* The exported function: Initialize and return the module's gamelogic
- * structure.
+/* The exported function: Create a new instance of the engine and
+ * return its gamelogic structure. Each call yields an independent
+ * instance; the caller must attach a gamestate to it before use.
  */
 gamelogic *mslogicstartup(void)
 {
-	static gamelogic	logic;
-
-	logic.ruleset = Ruleset_MS;
-	logic.initgame = initgame;
-	logic.advancegame = advancegame;
-	logic.endgame = endgame;
-	logic.shutdown = shutdown;
-
-	return &logic;
+	gamelogic	       *logic;
+	mslogiccontext	       *context;
+
+	logic = (gamelogic *)calloc(1, sizeof *logic);
+	context = (mslogiccontext *)calloc(1, sizeof *context);
+	if (!logic || !context)
+		memerrexit();
+
+	logic->ruleset = Ruleset_MS;
+	logic->state = NULL;
+	logic->context = context;
+	logic->initgame = initgame;
+	logic->advancegame = advancegame;
+	logic->endgame = endgame;
+	logic->savesnapshot = savesnapshot;
+	logic->restoresnapshot = restoresnapshot;
+	logic->shutdown = shutdown;
+
+	return logic;
 }
@@ -40,12 +40,18 @@ Qt_Surface::Qt_Surface(int w, int h, bool bTransparent)
 /* Load the given bitmap file.
  */
 Qt_Surface::Qt_Surface(const char* szFilename)
+	: Qt_Surface(QImage(szFilename))
 {
-	QImage image(szFilename);
-	if (image.isNull())
+}
+
+/* Use the given image, which may have been loaded on another thread.
+ */
+Qt_Surface::Qt_Surface(const QImage& loaded)
+{
+	if (loaded.isNull())
 		return;
 
-	image = image.convertToFormat(QImage::Format_ARGB32);
+	QImage image = loaded.convertToFormat(QImage::Format_ARGB32);
 	// Doesn't seem to be necessary, but just in case...
 
 	this->SetImage(image);
@@ -104,6 +110,7 @@ void Qt_Surface::SetImage(const QImage& image)
 
 const QPixmap& Qt_Surface::GetPixmap()
 {
+	FlushBatch();
 	SwitchToPixmap();
 	return m_pixmap;
 }
@@ -118,6 +125,7 @@ void Qt_Surface::SwitchToPixmap()
 
 void Qt_Surface::SwitchToImage()
 {
+	FlushBatch();
 	if (m_image.isNull()) {
 		m_image = m_pixmap.toImage();
 		m_pixmap = QPixmap();
@@ -128,6 +136,7 @@ void Qt_Surface::SwitchToImage()
 
 void Qt_Surface::FillRect(const TW_Rect* pDstRect, uint32_t nColor)
 {
+	FlushBatch();
 	SwitchToPixmap();
 	// TODO?: don't force image -> pixmap?
 	// TODO?: for 8-bit?
@@ -159,6 +168,12 @@ void Qt_Surface::BlitSurface(Qt_Surface* pSrc, const TW_Rect* pSrcRect,
 		srcRect.h = dstRect.h;
 	}
 
+	if (pDst->m_bBatching && !pSrc->IsColorKeySet()) {
+		pDst->QueueBlit(pSrc->GetPixmap(), srcRect, dstRect);
+		return;
+	}
+	pDst->FlushBatch();
+
 	// TODO?: don't force image -> pixmap?
 
 	pDst->SwitchToPixmap();
@@ -186,6 +201,88 @@ void Qt_Surface::BlitSurface(Qt_Surface* pSrc, const TW_Rect* pSrcRect,
 }
 
 
+void Qt_Surface::ScaleSurface(Qt_Surface* pSrc, const TW_Rect* pSrcRect,
+	Qt_Surface* pDst, const TW_Rect* pDstRect)
+{
+	pSrc->SwitchToImage();
+	pDst->SwitchToImage();
+
+	QImage image = pSrc->m_image.copy(*pSrcRect).scaled(pDstRect->w,
+		pDstRect->h, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	{
+		QPainter painter(&(pDst->m_image));
+		painter.setCompositionMode(QPainter::CompositionMode_Source);
+		painter.drawImage(QRect(*pDstRect).topLeft(), image);
+	}
+
+	pDst->InitImage();
+}
+
+
+/* Start queueing blits onto this surface.
+ */
+void Qt_Surface::BeginBatch()
+{
+	SwitchToPixmap();
+	pixels = 0;
+	m_bBatching = true;
+}
+
+/* Draw the queued blits and stop queueing.
+ */
+void Qt_Surface::EndBatch()
+{
+	FlushBatch();
+	m_bBatching = false;
+}
+
+/* Add a blit to the queue. Consecutive blits from the same pixmap are
+ * kept in one run, so that they can be submitted in one call. The run
+ * holds its own reference to the pixmap, so the source surface may be
+ * drawn on again before the batch is flushed.
+ */
+void Qt_Surface::QueueBlit(const QPixmap& srcPix, const TW_Rect& srcRect,
+	const TW_Rect& dstRect)
+{
+	if (m_nBatchRuns == 0
+			|| m_batch[m_nBatchRuns - 1].pixmap.cacheKey() != srcPix.cacheKey()) {
+		if (m_nBatchRuns == (int)m_batch.size())
+			m_batch.emplace_back();
+		m_batch[m_nBatchRuns++].pixmap = srcPix;
+	}
+	m_batch[m_nBatchRuns - 1].fragments.push_back(
+		QPainter::PixmapFragment::create(
+			QPointF(dstRect.x + srcRect.w / 2.0, dstRect.y + srcRect.h / 2.0),
+			QRectF(srcRect.x, srcRect.y, srcRect.w, srcRect.h)));
+}
+
+/* Draw any queued blits, using one painter for all of them. The runs
+ * are kept for reuse, so that a steady stream of batches does not
+ * allocate.
+ */
+void Qt_Surface::FlushBatch()
+{
+	if (m_nBatchRuns == 0)
+		return;
+
+	SwitchToPixmap();
+	{
+		QPainter painter(&m_pixmap);
+		for (int i = 0; i < m_nBatchRuns; ++i) {
+			BlitRun& run = m_batch[i];
+			painter.drawPixmapFragments(run.fragments.data(),
+				(int)run.fragments.size(), run.pixmap);
+		}
+	}
+
+	for (int i = 0; i < m_nBatchRuns; ++i) {
+		m_batch[i].pixmap = QPixmap();
+		m_batch[i].fragments.clear();
+	}
+	m_nBatchRuns = 0;
+}
+
+
 void Qt_Surface::SetColorKey(uint32_t nColorKey)
 {
 	m_nColorKey = nColorKey;
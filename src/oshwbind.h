@@ -10,6 +10,9 @@
 
 #include <QPixmap>
 #include <QImage>
+#include <QPainter>
+
+#include <vector>
 
 struct gamestate;
 
@@ -34,6 +37,7 @@ public:
 	Qt_Surface();
 	Qt_Surface(int w, int h, bool bTransparent);
 	explicit Qt_Surface(const char* szFilename);
+	explicit Qt_Surface(const QImage& image);
 
 	int w = 0;
 	int h = 0;
@@ -53,6 +57,19 @@ public:
 	static void BlitSurface(Qt_Surface* pSrc, const TW_Rect* pSrcRect,
 							Qt_Surface* pDst, const TW_Rect* pDstRect);
 
+	/* Copy an area of one surface into an area of another, smoothly
+	 * rescaling it to fit. The pixels of the destination area are
+	 * replaced, alpha included, rather than blended with.
+	 */
+	static void ScaleSurface(Qt_Surface* pSrc, const TW_Rect* pSrcRect,
+							 Qt_Surface* pDst, const TW_Rect* pDstRect);
+
+	/* Between BeginBatch() and EndBatch(), blits onto this surface are
+	 * queued, and then drawn all together with a single painter.
+	 */
+	void BeginBatch();
+	void EndBatch();
+
 	void SetColorKey(uint32_t nColorKey);
 	void ResetColorKey();
 
@@ -60,6 +77,8 @@ public:
 		{return m_bColorKeySet;}
 	inline uint32_t GetColorKey() const
 		{return m_nColorKey;}
+	inline bool HasAlphaChannel() const
+		{return hasAlphaChannel != 0;}
 
 	Qt_Surface* DisplayFormat();
 
@@ -78,8 +97,24 @@ private:
 	bool m_bColorKeySet = false;
 	uint32_t m_nColorKey = 0;
 
+	/* A run of queued blits that all come from the same pixmap.
+	 */
+	struct BlitRun
+	{
+		QPixmap pixmap;
+		std::vector<QPainter::PixmapFragment> fragments;
+	};
+
+	bool m_bBatching = false;
+	std::vector<BlitRun> m_batch;
+	int m_nBatchRuns = 0;
+
 	void Init(const QPaintDevice& dev);
 	void InitImage();
+
+	void QueueBlit(const QPixmap& srcPix, const TW_Rect& srcRect,
+				   const TW_Rect& dstRect);
+	void FlushBatch();
 };
 
 
@@ -22,10 +22,33 @@
 #include	"logic.h"
 #include	"err.h"
 
+/* A snapshot of a game in progress: a copy of the gamestate, with no
+ * move list of its own, and of the logic engine's private data.
+ */
+struct gamesnapshot {
+	gamestate	state;			/* the copy of the game state */
+	void	       *data;			/* the engine's private data */
+	size_t		size;			/* the size of data */
+};
+
+/* A copy of what the display needs from a game in progress: the
+ * gamestate, with no move list, and the creature list it points to.
+ */
+struct gameframe {
+	gamestate	state;			/* the copy of the game state */
+	creature       *creatures;		/* the copy of the creature list */
+	int		allocated;		/* the size of creatures */
+};
+
 /* The current state of the current game.
  */
 static gamestate	state;
 
+/* The frame that the display shows instead of the current game, or
+ * NULL if it shows the current game.
+ */
+static gameframe const *shownframe = NULL;
+
 /* The current logic module.
  */
 static gamelogic       *logic = NULL;
@@ -91,58 +114,74 @@ static bool setrulesetbehavior(int ruleset)
 	return true;
 }
 
-/* Initialize the current state to the starting position of the
- * given level.
+/* Reset st to the starting position of the given level, and start up
+ * lg on it. The caller is responsible for seeding st's PRNG.
  */
-bool initgamestate(gamesetup *game, int ruleset)
+static bool startstate(gamestate *st, gamelogic *lg, gamesetup *game,
+	int ruleset)
 {
-	if (!setrulesetbehavior(ruleset))
-		die("unable to initialize the system for the requested ruleset");
-
-	memset(state.map, 0, sizeof state.map);
-	state.game = game;
-	state.ruleset = ruleset;
-	state.replay = -1;
-	state.currenttime = -1;
-	state.timeoffset = 0;
-	state.currentinput = NIL;
-	state.lastmove = NIL;
-	state.initrndslidedir = NIL;
-	state.stepping = -1;
-	state.statusflags = 0;
-	state.soundeffects = 0;
-	state.timelimit = game->time * TICKS_PER_SECOND;
-	initmovelist(&state.moves);
-	resetprng(&state.mainprng);
-
-	if (!expandleveldata(&state))
+	memset(st->map, 0, sizeof st->map);
+	st->game = game;
+	st->ruleset = ruleset;
+	st->replay = -1;
+	st->currenttime = -1;
+	st->timeoffset = 0;
+	st->currentinput = NIL;
+	st->lastmove = NIL;
+	st->initrndslidedir = NIL;
+	st->stepping = -1;
+	st->statusflags = 0;
+	st->soundeffects = 0;
+	st->timelimit = game->time * TICKS_PER_SECOND;
+	initmovelist(&st->moves);
+
+	if (!expandleveldata(st))
 		return false;
 
-	return (*logic->initgame)(logic);
+	return (*lg->initgame)(lg);
 }
 
-/* Change the current state to run from the recorded solution.
+/* Change st to run from its level's recorded solution.
  */
-bool prepareplayback(void)
+static bool playbackstate(gamestate *st)
 {
 	solutioninfo	solution;
 
-	if (!state.game->solutionsize)
+	if (!st->game->solutionsize)
 		return false;
 	solution.moves.list = NULL;
 	solution.moves.allocated = 0;
-	if (!expandsolution(&solution, state.game) || !solution.moves.count)
+	if (!expandsolution(&solution, st->game) || !solution.moves.count)
 		return false;
 
-	destroymovelist(&state.moves);
-	state.moves = solution.moves;
-	restartprng(&state.mainprng, solution.rndseed);
-	state.initrndslidedir = solution.rndslidedir;
-	state.stepping = solution.stepping;
-	state.replay = 0;
+	destroymovelist(&st->moves);
+	st->moves = solution.moves;
+	restartprng(&st->mainprng, solution.rndseed);
+	st->initrndslidedir = solution.rndslidedir;
+	st->stepping = solution.stepping;
+	st->replay = 0;
 	return true;
 }
 
+/* Initialize the current state to the starting position of the
+ * given level.
+ */
+bool initgamestate(gamesetup *game, int ruleset)
+{
+	if (!setrulesetbehavior(ruleset))
+		die("unable to initialize the system for the requested ruleset");
+
+	resetprng(&state.mainprng);
+	return startstate(&state, logic, game, ruleset);
+}
+
+/* Change the current state to run from the recorded solution.
+ */
+bool prepareplayback(void)
+{
+	return playbackstate(&state);
+}
+
 /* Return the amount of time passed in the current game, in seconds.
  */
 int secondsplayed(void)
@@ -150,6 +189,13 @@ int secondsplayed(void)
 	return (state.currenttime + state.timeoffset) / TICKS_PER_SECOND;
 }
 
+/* Return the amount of time passed in the current game, in ticks.
+ */
+int ticksplayed(void)
+{
+	return state.currenttime + state.timeoffset;
+}
+
 /* Change the system behavior according to the given gameplay mode.
  */
 void setgameplaymode(int mode)
@@ -202,84 +248,150 @@ int getstepping()
 	return state.stepping;
 }
 
-/* Advance the game one tick and update the game state. cmd is the
- * current keyboard command supplied by the user. The return value is
- * positive if the game was completed successfully, negative if the
- * game ended unsuccessfully, and zero otherwise.
+/* Advance st one tick, to the given tick count, and update the game
+ * state. cmd is the current keyboard command supplied by the user. The
+ * return value is positive if the game was completed successfully,
+ * negative if the game ended unsuccessfully, and zero otherwise.
  */
-int doturn(int cmd)
+static int advancestate(gamestate *st, gamelogic *lg, int tick, int cmd)
 {
 	action	act;
 	int		n;
 
-	state.soundeffects &= ~((1 << SND_ONESHOT_COUNT) - 1);
-	state.currenttime = gettickcount();
-	if (state.currenttime >= MAXIMUM_TICK_COUNT) {
+	st->soundeffects &= ~((1 << SND_ONESHOT_COUNT) - 1);
+	st->currenttime = tick;
+	if (st->currenttime >= MAXIMUM_TICK_COUNT) {
 		warn("timer reached its maximum of %d.%d hours; quitting now",
 			MAXIMUM_TICK_COUNT / (TICKS_PER_SECOND * 3600),
 			(MAXIMUM_TICK_COUNT / (TICKS_PER_SECOND * 360)) % 10);
 		return -1;
 	}
-	if (state.replay < 0) {
+	if (st->replay < 0) {
 		if (cmd != CmdPreserve)
-			state.currentinput = cmd;
+			st->currentinput = cmd;
 	} else {
-		if (state.replay < state.moves.count) {
-			if (state.currenttime > state.moves.list[state.replay].when)
+		if (st->replay < st->moves.count) {
+			if (st->currenttime > st->moves.list[st->replay].when)
 				warn("Replay: Got ahead of saved solution: %d > %d!",
-					state.currenttime, state.moves.list[state.replay].when);
-			if (state.currenttime == state.moves.list[state.replay].when) {
-				state.currentinput = state.moves.list[state.replay].dir;
-				++state.replay;
+					st->currenttime, st->moves.list[st->replay].when);
+			if (st->currenttime == st->moves.list[st->replay].when) {
+				st->currentinput = st->moves.list[st->replay].dir;
+				++st->replay;
 			}
 		} else {
-			n = state.currenttime + state.timeoffset - 1;
-			if (n > state.game->besttime)
+			n = st->currenttime + st->timeoffset - 1;
+			if (n > st->game->besttime)
 				return -1;
 		}
 	}
 
-	n = (*logic->advancegame)(logic);
+	n = (*lg->advancegame)(lg);
 
-	if (state.replay < 0 && state.lastmove) {
-		act.when = state.currenttime;
-		act.dir = state.lastmove;
-		addtomovelist(&state.moves, act);
-		state.lastmove = NIL;
+	if (st->replay < 0 && st->lastmove) {
+		act.when = st->currenttime;
+		act.dir = st->lastmove;
+		addtomovelist(&st->moves, act);
+		st->lastmove = NIL;
 	}
 
 	return n;
 }
 
+/* Advance the current game one tick.
+ */
+int doturn(int cmd)
+{
+	return advancestate(&state, logic, gettickcount(), cmd);
+}
+
+/* Display the given game state.
+ */
+static void displaygame(gamestate const *st)
+{
+	int	currenttime;
+	int timeleft, besttime;
+
+	currenttime = st->currenttime + st->timeoffset;
+
+	int const starttime = (st->game->time ? st->game->time : 999);
+	if (hassolution(st->game))
+		besttime = starttime - st->game->besttime / TICKS_PER_SECOND;
+	else
+		besttime = TIME_NIL;
+
+	timeleft = starttime - currenttime / TICKS_PER_SECOND;
+	if (st->game->time && timeleft <= 0) {
+		timeleft = 0;
+	}
+
+	g_pMainWnd->DisplayGame(st, timeleft, besttime);
+}
+
 /* Update the display to show the current game state (including sound
  * effects, if any). If showframe is FALSE, then nothing is actually
- * displayed.
+ * displayed. While a frame is being shown in place of the current
+ * game, that frame is redisplayed instead, without sound.
  */
 void drawscreen(bool showframe)
 {
-	int	currenttime;
-	int timeleft, besttime;
+	if (showframe && shownframe) {
+		displaygame(&shownframe->state);
+		return;
+	}
 
-	playsoundeffects(state.soundeffects);
+	playsoundeffects(timerturbo() ? 0 : state.soundeffects);
 	state.soundeffects &= ~((1 << SND_ONESHOT_COUNT) - 1);
 
 	if (!showframe)
 		return;
 
-	currenttime = state.currenttime + state.timeoffset;
+	displaygame(&state);
+}
 
-	int const starttime = (state.game->time ? state.game->time : 999);
-	if (hassolution(state.game))
-		besttime = starttime - state.game->besttime / TICKS_PER_SECOND;
-	else
-		besttime = TIME_NIL;
+/* Copy what the display needs from the current game into frame,
+ * reusing its memory if it is not NULL.
+ */
+gameframe *savegameframe(gameframe *frame)
+{
+	int	n;
 
-	timeleft = starttime - currenttime / TICKS_PER_SECOND;
-	if (state.game->time && timeleft <= 0) {
-		timeleft = 0;
+	if (!frame) {
+		x_type_malloc(gameframe, frame, sizeof *frame);
+		frame->creatures = NULL;
+		frame->allocated = 0;
+	}
+	for (n = 1 ; state.creatures[n - 1].id ; ++n) ;
+	if (n > frame->allocated) {
+		frame->allocated = n;
+		x_type_alloc(creature, frame->creatures,
+			     n * sizeof *frame->creatures);
 	}
+	memcpy(frame->creatures, state.creatures, n * sizeof *frame->creatures);
+	frame->state = state;
+	frame->state.moves.list = NULL;
+	frame->state.moves.allocated = 0;
+	frame->state.creatures = frame->creatures;
+	return frame;
+}
+
+/* Display frame in place of the current game, or go back to showing
+ * the current game if frame is NULL.
+ */
+void showgameframe(gameframe const *frame)
+{
+	shownframe = frame;
+	if (frame)
+		displaygame(&frame->state);
+}
 
-	g_pMainWnd->DisplayGame(&state, timeleft, besttime);
+/* Free the frame.
+ */
+void freegameframe(gameframe *frame)
+{
+	if (frame) {
+		free(frame->creatures);
+		free(frame);
+	}
 }
 
 /* Stop game play and clean up.
@@ -323,10 +435,85 @@ void setenddisplay(void)
 	(*logic->initgame)(logic);
 }
 
+/*
+ * Snapshot functions.
+ */
+
+/* Copy the current game into snap, allocating a new snapshot if snap
+ * is NULL.
+ */
+gamesnapshot *savegamesnapshot(gamesnapshot *snap)
+{
+	if (!snap) {
+		x_type_malloc(gamesnapshot, snap, sizeof *snap);
+		snap->data = NULL;
+		snap->size = 0;
+	}
+	snap->state = state;
+	snap->state.moves.list = NULL;
+	snap->state.moves.allocated = 0;
+	snap->size = (*logic->savesnapshot)(logic, &snap->data);
+	return snap;
+}
+
+/* Copy snap back into the current game. The current move list is kept
+ * (cut back to its earlier length), as is the shutter, which belongs
+ * to the user interface rather than to the game.
+ */
+bool restoregamesnapshot(gamesnapshot const *snap)
+{
+	actlist	moves;
+	short	shuttered;
+
+	if (!logic || snap->state.game != state.game
+		   || snap->state.ruleset != state.ruleset
+		   || snap->state.moves.count > state.moves.count)
+		return false;
+
+	moves = state.moves;
+	shuttered = state.statusflags & SF_SHUTTERED;
+	state = snap->state;
+	state.moves = moves;
+	state.moves.count = snap->state.moves.count;
+	state.statusflags = (state.statusflags & ~SF_SHUTTERED) | shuttered;
+	return (*logic->restoresnapshot)(logic, snap->data);
+}
+
+/* Return the tick count at which the snapshot was taken.
+ */
+int gamesnapshottime(gamesnapshot const *snap)
+{
+	return snap->state.currenttime;
+}
+
+/* Return the memory used by the snapshot.
+ */
+size_t gamesnapshotsize(gamesnapshot const *snap)
+{
+	return sizeof *snap + snap->size;
+}
+
+/* Free the snapshot.
+ */
+void freegamesnapshot(gamesnapshot *snap)
+{
+	if (snap) {
+		free(snap->data);
+		free(snap);
+	}
+}
+
 /*
  * Solution handling functions.
  */
 
+/* Mark the current game so that it will not be saved as a solution.
+ */
+void disablesaving(void)
+{
+	state.statusflags |= SF_NOSAVING;
+}
+
 /* Return TRUE if a solution exists for the given level.
  */
 bool hassolution(gamesetup const *game)
@@ -364,32 +551,80 @@ bool replacesolution(void)
 	return true;
 }
 
-/* Double-checks the timing for a solution that has just been played
- * back. If the timing is off, and the cause of the discrepancy can be
- * reasonably ascertained to be benign, the timing will be corrected
- * and TRUE is returned.
+/* Double-checks the timing for a solution that has been played back
+ * to the given time. If the timing is off, and the cause of the
+ * discrepancy can be reasonably ascertained to be benign, the timing
+ * will be corrected and TRUE is returned.
  */
-bool checksolution(void)
+bool checksolutiontime(gamesetup *game, int currenttime, int timeoffset)
 {
-	int	currenttime;
+	int	totaltime;
 
-	if (!hassolution(state.game))
+	if (!hassolution(game))
 		return false;
-	currenttime = state.currenttime + state.timeoffset;
-	if (currenttime == state.game->besttime)
+	totaltime = currenttime + timeoffset;
+	if (totaltime == game->besttime)
 		return false;
 	warn("saved game has solution time of %d ticks, but replay took %d ticks",
-		state.game->besttime, currenttime);
-	if (state.game->besttime == state.currenttime) {
+		game->besttime, totaltime);
+	if (game->besttime == currenttime) {
 		warn("difference matches clock offset; fixing.");
-		state.game->besttime = currenttime;
+		game->besttime = totaltime;
 		return true;
-	} else if (currenttime - state.game->besttime == 1) {
+	} else if (totaltime - game->besttime == 1) {
 		warn("difference matches pre-0.10.1 error; fixing.");
-		state.game->besttime = currenttime;
+		game->besttime = totaltime;
 		return true;
 	}
 	warn("reason for difference unknown.");
-	state.game->besttime = currenttime;
+	game->besttime = totaltime;
 	return false;
 }
+
+/* Double-checks the timing for the solution that has just been played
+ * back in the current game.
+ */
+bool checksolution(void)
+{
+	return checksolutiontime(state.game, state.currenttime, state.timeoffset);
+}
+
+/* Replay a level's solution on a private game state and logic
+ * instance. The timer is not used: the tick count simply advances by
+ * one each turn. Nothing in this function touches the current game,
+ * so several replays can run at once on separate threads.
+ */
+int replaysolution(gamesetup *game, int ruleset,
+	int *currenttime, int *timeoffset)
+{
+	gamestate	       *st;
+	gamelogic	       *lg;
+	int			tick, n;
+
+	switch (ruleset) {
+		case Ruleset_Lynx:	lg = lynxlogicstartup();	break;
+		case Ruleset_MS:	lg = mslogicstartup();		break;
+		default:		return 0;
+	}
+	if (!lg)
+		return 0;
+	if (!(st = (gamestate *)calloc(1, sizeof *st)))
+		memerrexit();
+	lg->state = st;
+
+	restartprng(&st->mainprng, 0);
+	n = 0;
+	if (startstate(st, lg, game, ruleset) && playbackstate(st)) {
+		for (tick = 0 ; ; ++tick)
+			if ((n = advancestate(st, lg, tick, CmdNone)))
+				break;
+		*currenttime = st->currenttime;
+		*timeoffset = st->timeoffset;
+	}
+	(*lg->endgame)(lg);
+
+	destroymovelist(&st->moves);
+	free(st);
+	(*lg->shutdown)(lg);
+	return n;
+}
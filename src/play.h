@@ -16,6 +16,14 @@ enum {
 	NonrenderPlay
 };
 
+/* A saved copy of a game in progress.
+ */
+typedef struct gamesnapshot gamesnapshot;
+
+/* A copy of what the display needs from a game in progress.
+ */
+typedef struct gameframe gameframe;
+
 /* TRUE if the program is running without a user interface.
  */
 extern bool batchmode;
@@ -48,6 +56,10 @@ extern int getstepping();
  */
 extern int secondsplayed(void);
 
+/* Return the amount of time passed in the current game, in ticks.
+ */
+extern int ticksplayed(void);
+
 /* Handle one tick of the game. cmd is the current keyboard command
  * supplied by the user, or CmdPreserve if any pending command is to
  * be retained. The return value is positive if the game was completed
@@ -61,6 +73,23 @@ extern int doturn(int cmd);
  */
 extern void drawscreen(bool showframe);
 
+/* Copy what the display needs from the current game, so that it can
+ * be displayed while the game carries on. frame, if not NULL, is an
+ * earlier frame whose memory is reused.
+ */
+extern gameframe *savegameframe(gameframe *frame);
+
+/* Display frame in place of the current game. Until this is called
+ * again with NULL, drawscreen() redisplays frame rather than the
+ * current game, so that the display can be redrawn without touching
+ * a game that is being run by another thread.
+ */
+extern void showgameframe(gameframe const *frame);
+
+/* Free the frame.
+ */
+extern void freegameframe(gameframe *frame);
+
 /* Quit game play early.
  */
 extern void quitgamestate();
@@ -78,6 +107,36 @@ extern void shutdowngamestate(void);
  */
 extern void setenddisplay(void);
 
+/* Take a snapshot of the current game, including the logic engine's
+ * private data. snap, if not NULL, is an earlier snapshot whose memory
+ * is reused. The move list is not copied, only its length; restoring
+ * truncates the current move list back to that length.
+ */
+extern gamesnapshot *savegamesnapshot(gamesnapshot *snap);
+
+/* Return the current game to the moment the snapshot was taken. Play
+ * continues exactly as it did from that point. FALSE is returned if the
+ * snapshot belongs to a different game or ruleset, or if the move list
+ * has since been cut back past the snapshot.
+ */
+extern bool restoregamesnapshot(gamesnapshot const *snap);
+
+/* Return the tick count at which the snapshot was taken.
+ */
+extern int gamesnapshottime(gamesnapshot const *snap);
+
+/* Return the amount of memory used by the snapshot, in bytes.
+ */
+extern size_t gamesnapshotsize(gamesnapshot const *snap);
+
+/* Free the snapshot.
+ */
+extern void freegamesnapshot(gamesnapshot *snap);
+
+/* Mark the current game so that it will not be saved as a solution.
+ */
+extern void disablesaving(void);
+
 /* Return TRUE if a solution exists for the given level.
  */
 extern bool hassolution(gamesetup const *game);
@@ -95,6 +154,22 @@ extern bool replacesolution();
  */
 extern bool checksolution(void);
 
+/* Double-check the timing for a solution of game that was played back
+ * with the given final tick count and time offset, correcting the
+ * recorded time in the same way as checksolution().
+ */
+extern bool checksolutiontime(gamesetup *game, int currenttime, int timeoffset);
+
+/* Replay the saved solution for game on a private game state, without
+ * the timer, sound, or display. The return value is as for doturn(),
+ * or zero if the solution could not be replayed at all, in which case
+ * currenttime and timeoffset are left untouched. The current game is
+ * not affected, and this function may be called from several threads
+ * at once.
+ */
+extern int replaysolution(gamesetup *game, int ruleset,
+			  int *currenttime, int *timeoffset);
+
 /* Turn pedantic mode on. The ruleset will be slightly changed to be
  * as faithful as possible to the original source material.
  */
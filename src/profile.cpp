@@ -0,0 +1,111 @@
+/* profile.cpp: Optional timing of the game logic's inner loop.
+ *
+ * Licensed under the GNU General Public License. No warranty.
+ * See COPYING for details.
+ */
+
+#include	<atomic>
+#include	<cstdlib>
+#include	<cstring>
+#include	<cstdio>
+
+#include	"defs.h"
+#include	"profile.h"
+
+/* The running totals for one phase. These are updated from every
+ * thread that runs the logic, hence the atomics.
+ */
+struct profcounter {
+	std::atomic<unsigned long long>	calls;
+	std::atomic<long long>		total;	/* nanoseconds, inclusive */
+	std::atomic<long long>		self;	/* nanoseconds, exclusive */
+};
+
+static profcounter	counters[Ruleset_Count][PROF_COUNT];
+
+/* The names of the phases, as they appear in the report.
+ */
+static char const *phasenames[PROF_COUNT] = {
+	"advancegame", "choosemove", "advancecreature", "slips",
+	"teleport", "checkforending", "preparedisplay"
+};
+
+/* TRUE once the report has been registered to run at exit.
+ */
+static bool	reportregistered = false;
+
+/* The innermost scope being timed on this thread.
+ */
+thread_local profscope *profscope::current = nullptr;
+
+/* At shutdown time, display the totals on stdout. Total time includes
+ * the time spent in any other phase called from within a phase (and
+ * counts recursive calls more than once); self time does not.
+ */
+static void report(void)
+{
+	profcounter	       *c;
+	unsigned long long	calls;
+	long long		total, self, ticktime;
+	int			ruleset, i;
+
+	for (ruleset = Ruleset_First ; ruleset < Ruleset_Count ; ++ruleset) {
+		c = counters[ruleset];
+		if (!c[PROF_TICK].calls)
+			continue;
+		ticktime = c[PROF_TICK].total;
+		printf("Logic profile, %s ruleset"
+		       " (total/self in ms, self as %% of advancegame)\n",
+			ruleset == Ruleset_MS ? "MS" : "Lynx");
+		printf("%-16s %12s %11s %11s %6s %8s\n",
+			"phase", "calls", "total", "self", "self%", "ns/call");
+		for (i = 0 ; i < PROF_COUNT ; ++i) {
+			calls = c[i].calls;
+			if (!calls)
+				continue;
+			total = c[i].total;
+			self = c[i].self;
+			printf("%-16s %12llu %11.1f %11.1f %5.1f%% %8.0f\n",
+				phasenames[i], calls, total / 1e6, self / 1e6,
+				ticktime > 0 ? (self * 100.0) / ticktime : 0.0,
+				(double)total / calls);
+		}
+	}
+}
+
+/* Add one call of the given phase of the given ruleset to the totals.
+ */
+void profilecall(int ruleset, int phase, long long total, long long self)
+{
+	profcounter    *c = &counters[ruleset][phase];
+
+	++c->calls;
+	c->total += total;
+	c->self += self;
+}
+
+/* Turn profiling on or off.
+ */
+void setprofiling(bool on)
+{
+	if (on && !reportregistered) {
+		reportregistered = true;
+		atexit(report);
+	}
+	profiling = on;
+}
+
+/* Profiling is off unless the environment asks for it.
+ */
+static bool initprofiling(void)
+{
+	char const *env = getenv("TWORLD_PROFILE");
+
+	if (!env || !*env || !strcmp(env, "0"))
+		return false;
+	reportregistered = true;
+	atexit(report);
+	return true;
+}
+
+bool	profiling = initprofiling();
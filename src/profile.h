@@ -0,0 +1,90 @@
+/* profile.h: Optional timing of the game logic's inner loop.
+ *
+ * Licensed under the GNU General Public License. No warranty.
+ * See COPYING for details.
+ */
+
+#ifndef	HEADER_profile_h_
+#define	HEADER_profile_h_
+
+#include	<chrono>
+
+/* The parts of a game tick that are timed separately.
+ */
+enum {
+	PROF_TICK,		/* the whole of advancegame() */
+	PROF_CHOOSEMOVE,	/* choosemove() */
+	PROF_ADVANCECREATURE,	/* advancecreature() */
+	PROF_SLIPS,		/* floormovements() and updatesliplist() (MS) */
+	PROF_TELEPORT,		/* teleportcreature() */
+	PROF_CHECKFORENDING,	/* checkforending() (MS) */
+	PROF_PREPAREDISPLAY,	/* preparedisplay() */
+	PROF_COUNT
+};
+
+/* TRUE if the logic is being profiled. This is turned on at startup
+ * if the TWORLD_PROFILE environment variable is set.
+ */
+extern bool profiling;
+
+/* Turn profiling on or off. The first time it is turned on, the
+ * report is arranged to be displayed on stdout when the program exits.
+ */
+extern void setprofiling(bool on);
+
+/* Add one call of the given phase of the given ruleset to the totals.
+ */
+extern void profilecall(int ruleset, int phase, long long total,
+			long long self);
+
+/* An object that times the scope it is declared in, when profiling
+ * is turned on. Time spent in nested scopes is subtracted from the
+ * enclosing scope's self time.
+ */
+class profscope {
+public:
+	profscope(int ruleset, int phase)
+	{
+		if (!profiling) {
+			this->phase = -1;
+			return;
+		}
+		this->ruleset = ruleset;
+		this->phase = phase;
+		children = 0;
+		parent = current;
+		current = this;
+		start = std::chrono::steady_clock::now();
+	}
+	~profscope()
+	{
+		long long	elapsed;
+
+		if (phase < 0)
+			return;
+		elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>
+				(std::chrono::steady_clock::now() - start).count();
+		current = parent;
+		if (parent)
+			parent->children += elapsed;
+		profilecall(ruleset, phase, elapsed, elapsed - children);
+	}
+	profscope(profscope const&) = delete;
+	profscope& operator=(profscope const&) = delete;
+
+private:
+	std::chrono::steady_clock::time_point	start;
+	long long				children;
+	profscope			       *parent;
+	int					ruleset;
+	int					phase;
+
+	static thread_local profscope	       *current;
+};
+
+/* Time the rest of the enclosing block as the given phase of the
+ * given ruleset.
+ */
+#define	PROFILE(ruleset, phase)	profscope profscope_(ruleset, phase)
+
+#endif
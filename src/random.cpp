@@ -40,7 +40,7 @@ static unsigned long nextvalue(unsigned long value)
 static void nextrandom(prng *gen)
 {
 	if (gen->shared)
-		gen->value = lastvalue = nextvalue(lastvalue);
+		gen->value = lastvalue = nextvalue(gen->value);
 	else
 		gen->value = nextvalue(gen->value);
 }
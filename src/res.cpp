@@ -5,8 +5,12 @@
  * See COPYING for details.
  */
 
+#include	<QTimer>
+
+#include	<atomic>
 #include	<cstdlib>
 #include	<cstring>
+#include	<thread>
 
 #include	"defs.h"
 #include	"res.h"
@@ -18,11 +22,21 @@
 // the length of the longest res filename + a bit extra
 #define FILENAME_LEN 14
 
+// how often to check whether the background preload has finished
+#define PRELOAD_POLL_MS 50
+
 // res dir
-static int resPathLen = 0;
+static thread_local int resPathLen = 0;
 
 //fpstring
-static char *fpstring;
+static thread_local char *fpstring;
+
+// TRUE on the thread that reads files ahead of time, which only
+// prepares them and leaves the loading to the GUI thread
+static thread_local bool preparing = false;
+
+// the ruleset whose resources are currently selected
+static int currentRuleset = Ruleset_None;
 
 /* Attempt to load the tile images.
  */
@@ -34,6 +48,10 @@ static void LoadImages(int ruleset)
 		strcpy(fpstring + resPathLen, "tiles.bmp");
 	}
 
+	if(preparing) {
+		preparetileset(fpstring);
+		return;
+	}
 	if(!loadtileset(fpstring, true)) {
 		die("no valid tilesets found: %s", fpstring);
 	}
@@ -44,6 +62,8 @@ static void LoadImages(int ruleset)
 static int addSound(int i, const char *file)
 {
 	strcpy(fpstring + resPathLen, file);
+	if (preparing)
+		return preparesfxfile(fpstring);
 	return loadsfxfromfile(i, fpstring);
 }
 
@@ -90,14 +110,15 @@ static void LoadSounds(int ruleset)
 		count += addSound(SND_FIREWALKING,     "crackle.wav");
 	}
 
-	if (count == 0) setaudiosystem(false);
+	if (count == 0 && !preparing) setaudiosystem(false);
 }
 
 
 /* Load all resources that are available. The app dies if it can't load any tiles
- * but ignores a failure to find sounds.
+ * but ignores a failure to find sounds. Tiles and sounds that have been loaded
+ * before are kept in memory, and are not read again.
  */
-void loadgameresources(int ruleset)
+static void LoadResources(int ruleset)
 {
 	const char *resPath = getdir(RESDIR);
 	resPathLen = strlen(resPath);
@@ -113,3 +134,73 @@ void loadgameresources(int ruleset)
 
 	free(fpstring);
 }
+
+void loadgameresources(int ruleset)
+{
+	LoadResources(ruleset);
+	currentRuleset = ruleset;
+}
+
+/* The thread reading the other rulesets' files ahead of time, and
+ * whether it has finished.
+ */
+static std::thread preloadthread;
+static std::atomic<bool> preloaddone(false);
+
+/* Wait for the preload thread, if it is still running. This is called
+ * at exit, before the tile and sound modules are shut down, unless it
+ * is the preload thread itself that is exiting.
+ */
+static void joinpreload(void)
+{
+	if (preloadthread.joinable()
+			&& preloadthread.get_id() != std::this_thread::get_id())
+		preloadthread.join();
+}
+
+/* Read and decode the other rulesets' tiles and sounds.
+ */
+static void preparegameresources(int ruleset)
+{
+	preparing = true;
+	for (int r = Ruleset_First; r < Ruleset_Count; ++r) {
+		if (r != ruleset)
+			LoadResources(r);
+	}
+	preloaddone = true;
+}
+
+/* Once the preload thread is done, load what it read, which now only
+ * takes building the pixmaps, and then reselect the current ruleset's
+ * resources (if any).
+ */
+static void finishpreload(void)
+{
+	if (!preloaddone) {
+		QTimer::singleShot(PRELOAD_POLL_MS, finishpreload);
+		return;
+	}
+	joinpreload();
+	for (int ruleset = Ruleset_First; ruleset < Ruleset_Count; ++ruleset) {
+		if (ruleset != currentRuleset)
+			LoadResources(ruleset);
+	}
+	if (currentRuleset != Ruleset_None)
+		LoadResources(currentRuleset);
+}
+
+void preloadgameresources()
+{
+	static bool started = false;
+
+	if (started)
+		return;
+	started = true;
+	atexit(joinpreload);
+
+	// the sound device has to be open for the waves to be converted
+	// to its format
+	setaudiosystem(true);
+	preloadthread = std::thread(preparegameresources, currentRuleset);
+	QTimer::singleShot(PRELOAD_POLL_MS, finishpreload);
+}
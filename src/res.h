@@ -12,4 +12,11 @@
  */
 extern void loadgameresources(int ruleset);
 
+/* Load the resources of every ruleset ahead of time, leaving the
+ * current ruleset's selected. The files are read and decoded on a
+ * background thread; the rest is finished later on the GUI thread,
+ * from the event loop.
+ */
+extern void preloadgameresources(void);
+
 #endif
@@ -9,6 +9,7 @@
 
 #include	<cstdlib>
 #include	<cstring>
+#include	<mutex>
 
 #include	"sdlsfx.h"
 #include	"settings.h"
@@ -30,6 +31,20 @@ typedef	struct sfxinfo {
 	bool		playing;	/* is the wave currently playing? */
 } sfxinfo;
 
+/* A wave file that has been loaded and converted to the format of
+ * the sound device. Wave files are kept after they are first loaded,
+ * so that the sounds of each ruleset stay resident when switching
+ * between them.
+ */
+typedef struct sfxwave {
+	char	       *filename;	/* the file the wave was read from */
+	Uint8	       *wave;		/* the converted wave data */
+	Uint32		len;		/* size of the wave data */
+	SDL_AudioFormat	format;		/* the format it was converted to */
+	Uint8		channels;
+	int		freq;
+} sfxwave;
+
 /* The data needed to talk to the sound output device.
  */
 static SDL_AudioSpec	spec;
@@ -38,6 +53,22 @@ static SDL_AudioSpec	spec;
  */
 static sfxinfo		sounds[SND_COUNT];
 
+/* All of the wave files loaded so far.
+ */
+static sfxwave	       *waves = NULL;
+static int		wavecount = 0;
+
+/* The format of the sound device, for waves read ahead of time on
+ * another thread, and the waves so read that have not yet been added
+ * to the list of loaded waves. These are shared with that thread,
+ * hence the lock.
+ */
+static std::mutex	preparedlock;
+static SDL_AudioSpec	preparedspec;
+static bool		canprepare = false;
+static sfxwave	       *preparedwaves = NULL;
+static int		preparedcount = 0;
+
 /* TRUE if the program is currently talking to a sound device.
  */
 static bool		hasaudio = false;
@@ -50,13 +81,13 @@ static int		volume = SDL_MIX_MAXVOLUME;
  */
 static const int		soundbufsize = 0;
 
-/* Release all memory for the given sound effect.
+/* Remove the wave from the given sound effect. The wave data itself
+ * belongs to the list of loaded waves.
  */
 static void freesfx(int index)
 {
 	if (sounds[index].wave) {
 		SDL_LockAudio();
-		free(sounds[index].wave);
 		sounds[index].wave = NULL;
 		sounds[index].pos = 0;
 		sounds[index].playing = false;
@@ -122,6 +153,8 @@ bool setaudiosystem(bool active)
 			SDL_PauseAudio(true);
 			SDL_CloseAudio();
 			hasaudio = false;
+			std::lock_guard<std::mutex> hold(preparedlock);
+			canprepare = false;
 		}
 		return true;
 	}
@@ -149,14 +182,38 @@ bool setaudiosystem(bool active)
 	}
 	hasaudio = true;
 	SDL_PauseAudio(false);
+	{
+		std::lock_guard<std::mutex> hold(preparedlock);
+		preparedspec = spec;
+		canprepare = true;
+	}
 
 	return true;
 }
 
-/* Load a single wave file into memory. The wave data is converted to
- * the format expected by the sound device.
+/* Return the loaded wave for the given file in the current format of
+ * the sound device, or NULL if it has not been loaded yet.
  */
-bool loadsfxfromfile(int index, char const *filename)
+static sfxwave *findwave(char const *filename)
+{
+	int	n;
+
+	for (n = 0 ; n < wavecount ; ++n)
+		if (waves[n].format == spec.format
+				&& waves[n].channels == spec.channels
+				&& waves[n].freq == spec.freq
+				&& !strcmp(waves[n].filename, filename))
+			return &waves[n];
+	return NULL;
+}
+
+/* Read a wave file into w, converting it to the given format. FALSE
+ * is returned if the file could not be used. Errors are displayed only
+ * if complain is TRUE. Nothing else is touched, so this may be called
+ * from any thread.
+ */
+static bool convertwave(char const *filename, SDL_AudioSpec const *target,
+			sfxwave *w, bool complain)
 {
 	SDL_AudioSpec	specin;
 	SDL_AudioCVT	convert;
@@ -164,25 +221,19 @@ bool loadsfxfromfile(int index, char const *filename)
 	Uint8	       *wavecvt;
 	Uint32		lengthin;
 
-	if (!filename || filename[0] == '\0') {
-		freesfx(index);
-		return true;
-	}
-
-	if (!hasaudio)
-		if (!setaudiosystem(true))
-			return false;
-
 	if (!SDL_LoadWAV(filename, &specin, &wavein, &lengthin)) {
-		freesfx(index);
-		warn("can't load %s: %s", filename, SDL_GetError());
+		if (complain)
+			warn("can't load %s: %s", filename, SDL_GetError());
 		return false;
 	}
 
 	if (SDL_BuildAudioCVT(&convert,
 			specin.format, specin.channels, specin.freq,
-			spec.format, spec.channels, spec.freq) < 0) {
-		warn("can't create converter for %s: %s", filename, SDL_GetError());
+			target->format, target->channels, target->freq) < 0) {
+		if (complain)
+			warn("can't create converter for %s: %s", filename,
+				SDL_GetError());
+		SDL_FreeWAV(wavein);
 		return false;
 	}
 	if (!(wavecvt = (Uint8 *)malloc(lengthin * convert.len_mult)))
@@ -192,14 +243,85 @@ bool loadsfxfromfile(int index, char const *filename)
 	convert.buf = wavecvt;
 	convert.len = lengthin;
 	if (SDL_ConvertAudio(&convert) < 0) {
-		warn("can't convert %s: %s", filename, SDL_GetError());
+		if (complain)
+			warn("can't convert %s: %s", filename, SDL_GetError());
+		free(wavecvt);
+		return false;
+	}
+
+	x_cmalloc(w->filename, strlen(filename) + 1);
+	strcpy(w->filename, filename);
+	w->wave = convert.buf;
+	w->len = convert.len * convert.len_ratio;
+	w->format = target->format;
+	w->channels = target->channels;
+	w->freq = target->freq;
+	return true;
+}
+
+/* Read a wave file into memory and add it to the list of loaded waves.
+ * The wave data is converted to the format expected by the sound
+ * device. NULL is returned if the file could not be used.
+ */
+static sfxwave *readwave(char const *filename)
+{
+	sfxwave	w;
+
+	if (!convertwave(filename, &spec, &w, true))
+		return NULL;
+	x_type_alloc(sfxwave, waves, (wavecount + 1) * sizeof *waves);
+	waves[wavecount] = w;
+	return &waves[wavecount++];
+}
+
+/* Add the waves that were read ahead of time to the list of loaded
+ * waves, dropping any that have since been loaded anyway.
+ */
+static void adoptpreparedwaves(void)
+{
+	std::lock_guard<std::mutex> hold(preparedlock);
+	int	n;
+
+	for (n = 0 ; n < preparedcount ; ++n) {
+		if (findwave(preparedwaves[n].filename)) {
+			free(preparedwaves[n].wave);
+			free(preparedwaves[n].filename);
+			continue;
+		}
+		x_type_alloc(sfxwave, waves, (wavecount + 1) * sizeof *waves);
+		waves[wavecount++] = preparedwaves[n];
+	}
+	free(preparedwaves);
+	preparedwaves = NULL;
+	preparedcount = 0;
+}
+
+/* Load a single wave file into memory for the given sound effect. A
+ * file that has already been loaded is not read again.
+ */
+bool loadsfxfromfile(int index, char const *filename)
+{
+	sfxwave	       *w;
+
+	if (!filename || filename[0] == '\0') {
+		freesfx(index);
+		return true;
+	}
+
+	if (!hasaudio)
+		if (!setaudiosystem(true))
+			return false;
+
+	adoptpreparedwaves();
+	if (!(w = findwave(filename)) && !(w = readwave(filename))) {
+		freesfx(index);
 		return false;
 	}
 
 	freesfx(index);
 	SDL_LockAudio();
-	sounds[index].wave = convert.buf;
-	sounds[index].len = convert.len * convert.len_ratio;
+	sounds[index].wave = w->wave;
+	sounds[index].len = w->len;
 	sounds[index].pos = 0;
 	sounds[index].playing = false;
 	SDL_UnlockAudio();
@@ -207,6 +329,30 @@ bool loadsfxfromfile(int index, char const *filename)
 	return true;
 }
 
+/* Read and convert a wave file ahead of time. This may be called from
+ * any thread, once the sound device is open.
+ */
+bool preparesfxfile(char const *filename)
+{
+	SDL_AudioSpec	target;
+	sfxwave		w;
+
+	{
+		std::lock_guard<std::mutex> hold(preparedlock);
+		if (!canprepare)
+			return false;
+		target = preparedspec;
+	}
+	if (!convertwave(filename, &target, &w, false))
+		return false;
+
+	std::lock_guard<std::mutex> hold(preparedlock);
+	x_type_alloc(sfxwave, preparedwaves,
+		     (preparedcount + 1) * sizeof *preparedwaves);
+	preparedwaves[preparedcount++] = w;
+	return true;
+}
+
 /* Select the sounds effects to be played. sfx is a bitmask of sound
  * effect indexes. Any continuous sounds that are not included in sfx
  * are stopped. One-shot sounds that are included in sfx are
@@ -293,6 +439,14 @@ static void shutdown(void)
 
 	for (int n = 0; n < SND_COUNT; ++n)
 		freesfx(n);
+	adoptpreparedwaves();
+	for (int n = 0; n < wavecount; ++n) {
+		free(waves[n].wave);
+		free(waves[n].filename);
+	}
+	free(waves);
+	waves = NULL;
+	wavecount = 0;
 }
 
 /* Initialize the module.
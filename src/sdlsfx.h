@@ -17,9 +17,18 @@ extern bool setaudiosystem(bool active);
 
 /* Load a wave file into memory. index indicates which sound effect to
  * associate the sound with. FALSE is returned if an error occurs.
+ * Wave files stay in memory once loaded, so loading the same file
+ * again does not reread it.
  */
 extern bool loadsfxfromfile(int index, char const *filename);
 
+/* Read a wave file ahead of time, so that a later loadsfxfromfile()
+ * for it needs no disk access or conversion. This may be called from
+ * any thread once the sound system is active; no errors are displayed,
+ * and FALSE is returned if the file could not be read.
+ */
+extern bool preparesfxfile(char const *filename);
+
 /* Specify the sounds effects to be played at this time. sfx is the
  * bitwise-or of any number of sound effects. If a non-continuous
  * sound effect in sfx is already playing, it will be restarted. Any
@@ -18,6 +18,7 @@
 #include	"solution.h"
 #include	"unslist.h"
 #include	"series.h"
+#include	"play.h"
 #include	"TWMainWnd.h"
 #include	"utils.h"
 #include	"err.h"
@@ -344,7 +345,8 @@ bool readseriesfile(gameseries *series)
 		undomschanges(series);
 	markunsolvablelevels(series);
 	readsolutions(series);
-	g_pMainWnd->ReadExtensions(series);
+	if (!batchmode)
+		g_pMainWnd->ReadExtensions(series);
 	return true;
 }
 
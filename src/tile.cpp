@@ -4,12 +4,21 @@
  * under the GNU General Public License. No warranty. See COPYING for details.
  */
 
+#include	<cerrno>
+#include	<climits>
+#include	<cstddef>
 #include	<cstdlib>
+#include	<cstring>
+#include	<cstdio>
+#include	<mutex>
+#include	<vector>
+#include	<sys/stat.h>
 
 #include	"tile.h"
 #include	"oshwbind.h"
 #include	"defs.h"
 #include	"state.h"
+#include	"fileio.h"
 #include	"err.h"
 
 /* Direction offsets.
@@ -32,12 +41,13 @@
 #define	SIZE_EXTDOWN	0x08	/* image extended downards by one tile */
 #define	SIZE_EXTALL	0x0F		/* image is 3x3 tiles in size */
 
-/* Structure providing pointers to the various tile images available
- * for a given id.
+/* Structure identifying the various tile images available for a
+ * given id. Each image is a cel of the tile atlas, given by its index
+ * in the table of cel rectangles; zero indicates no image.
  */
 typedef struct tilemap {
-	Qt_Surface *opaque[16];		/* one or more opaque images */
-	Qt_Surface *transp[16];		/* one or more transparent images */
+	short opaque[16];			/* one or more opaque images */
+	short transp[16];			/* one or more transparent images */
 	char celcount;				/* count of animated images */
 	char transpsize;			/* flags for the transparent size */
 } tilemap;
@@ -190,44 +200,171 @@ static tileidinfo const tileidmap[NTILES] = {
 	{Entity_Explosion, 3, 7, -1, -1, TILEIMG_ANIMATION}
 };
 
-/* The heap of remembered surfaces.
+/* The number of tile-sized columns in the tile atlas.
  */
-static Qt_Surface **surfaceheap = NULL;
-static int surfacesused = 0;
-static int surfacesallocated = 0;
+#define	ATLAS_COLUMNS	16
+
+/* The tile atlas, which holds every cel of the current tile set, and
+ * the table of cel rectangles within it.
+ */
+static Qt_Surface *atlas = NULL;
+static TW_Rect *celrects = NULL;
+static int celsused = 0;
+static int celsallocated = 0;
+
+/* The position of the next free space in the atlas, and the height of
+ * the row of cels currently being filled.
+ */
+static int atlasx = 0;
+static int atlasy = 0;
+static int atlasrowh = 0;
+
+/* The atlas as it was loaded from the tile set, before scaling, with
+ * its cel rectangles and the size of its tiles. When no scaling is
+ * needed, atlas points to the same surface.
+ */
+static Qt_Surface *nativeatlas = NULL;
+static TW_Rect *nativerects = NULL;
+static int nativewtile = 0;
+static int nativehtile = 0;
+
+/* The size of the square that tiles are scaled to fit, or zero if
+ * tiles are drawn at their native size.
+ */
+static int displaytilesize = 0;
+
+/* A tile set that is loaded but not in use. The tile set that was
+ * last replaced is kept, so that alternating between two tile sets
+ * (as when switching between rulesets) does not reread either one.
+ */
+typedef struct residenttileset {
+	char	       *filename;
+	tilemap		tileptr[NTILES];
+	Qt_Surface     *atlas;
+	TW_Rect	       *celrects;
+	int		celsused;
+	int		celsallocated;
+	Qt_Surface     *nativeatlas;
+	TW_Rect	       *nativerects;
+	int		nativewtile;
+	int		nativehtile;
+	int		wtile;
+	int		htile;
+} residenttileset;
+
+/* The name of the file the current tile set was read from, and the
+ * spare tile set.
+ */
+static char *tilesetname = NULL;
+static residenttileset spare;
 
 /* The directory of tile images.
  */
 static tilemap tileptr[NTILES];
 
-/* An internal buffer surface.
+/* The number of composited cell images kept in the cache, and the
+ * number of columns of them in the cache surface. The cache must hold
+ * more cells than are ever visible at once.
+ */
+#define	CELLCACHE_SIZE		256
+#define	CELLCACHE_COLUMNS	16
+#define	CELLCACHE_BUCKETS	512
+
+/* An identifier for a composited cell image.
+ */
+#define	cellid(top, nt, bot, nb)	\
+	((unsigned long)(top) | ((bot) << 8) | ((nt) << 16) | ((nb) << 20))
+
+/* The hash table bucket for a composited cell image.
  */
-static Qt_Surface *opaquetile = NULL;
+#define	cellbucket(id)	\
+	((int)((((id) * 2654435761UL) >> 8) % CELLCACHE_BUCKETS))
 
-/* Add the given surface to the heap of remembered surfaces.
+/* An entry in the cache of composited cell images. The entries are
+ * kept on a list in order of use, most recent first, and are found
+ * through a hash table.
  */
-static void remembersurface(Qt_Surface * surface)
+typedef struct cachedcell {
+	unsigned long id;			/* the image held, or zero if none */
+	short prev;					/* the next more recently used entry */
+	short next;					/* the next less recently used entry */
+	short hashnext;				/* the next entry in the same bucket */
+} cachedcell;
+
+/* The cache of composited cell images. Each entry's image occupies a
+ * tile-sized slot of the cache surface.
+ */
+static Qt_Surface *cellcache = NULL;
+static cachedcell cachedcells[CELLCACHE_SIZE];
+static short cellcachebuckets[CELLCACHE_BUCKETS];
+static short cellcachefirst = -1;
+static short cellcachelast = -1;
+
+/* Return a pointer to the pixel at (x, y) of a 32-bit surface that is
+ * currently held as an image.
+ */
+static inline uint32_t *pixelat(Qt_Surface * s, int x, int y)
 {
-	if (surfacesused >= surfacesallocated) {
-		surfacesallocated += 256;
-		x_type_alloc(Qt_Surface *, surfaceheap, surfacesallocated * sizeof *surfaceheap);
+	return (uint32_t *)((unsigned char *)s->pixels + y * s->pitch) + x;
+}
+
+/* Create an empty atlas with room for about count tile-sized cels.
+ * Cel zero is reserved to mean no image.
+ */
+static void startatlas(int count)
+{
+	int rows;
+
+	rows = (count + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS + 1;
+	atlas = new Qt_Surface(ATLAS_COLUMNS * geng.wtile, rows * geng.htile, true);
+	atlasx = 0;
+	atlasy = 0;
+	atlasrowh = 0;
+	celsused = 1;
+	if (!celsallocated) {
+		celsallocated = 256;
+		x_type_alloc(TW_Rect, celrects, celsallocated * sizeof *celrects);
 	}
-	surfaceheap[surfacesused++] = surface;
+	celrects[0] = TW_Rect(0, 0, 0, 0);
 }
 
-/* Free all surfaces on the heap.
+/* Enlarge the atlas so that it is at least h pixels high.
  */
-static void freerememberedsurfaces(void)
+static void growatlas(int h)
 {
-	int n;
+	Qt_Surface *s;
+	int y;
+
+	if (h < 2 * atlas->h)
+		h = 2 * atlas->h;
+	s = new Qt_Surface(atlas->w, h, true);
+	for (y = 0; y < atlas->h; ++y)
+		memcpy(pixelat(s, 0, y), pixelat(atlas, 0, y), atlas->w * sizeof(uint32_t));
+	delete atlas;
+	atlas = s;
+}
 
-	for (n = 0; n < surfacesused; ++n)
-		if (surfaceheap[n])
-			delete surfaceheap[n];
-	free(surfaceheap);
-	surfaceheap = NULL;
-	surfacesused = 0;
-	surfacesallocated = 0;
+/* Allocate an unused area of the atlas for a cel of the given size,
+ * and return the new cel's index.
+ */
+static int newcel(int w, int h)
+{
+	if (atlasx + w > atlas->w) {
+		atlasx = 0;
+		atlasy += atlasrowh;
+		atlasrowh = 0;
+	}
+	if (atlasy + h > atlas->h)
+		growatlas(atlasy + h);
+	if (celsused >= celsallocated) {
+		celsallocated += 256;
+		x_type_alloc(TW_Rect, celrects, celsallocated * sizeof *celrects);
+	}
+	celrects[celsused] = TW_Rect(atlasx, atlasy, w, h);
+	atlasx += w;
+	if (atlasrowh < h)
+		atlasrowh = h;
+	return celsused++;
 }
 
 /* Set the size of one tile. FALSE is returned if the dimensions are
@@ -241,8 +378,9 @@ static bool settilesize(int w, int h)
 	}
 	geng.wtile = w;
 	geng.htile = h;
-	opaquetile = new Qt_Surface(w, h, false);
-	remembersurface(opaquetile);
+	delete cellcache;
+	cellcache = new Qt_Surface(CELLCACHE_COLUMNS * w,
+		(CELLCACHE_SIZE / CELLCACHE_COLUMNS) * h, false);
 	return true;
 }
 
@@ -250,33 +388,126 @@ static bool settilesize(int w, int h)
  * Functions for using tile images.
  */
 
-/* Overlay a transparent tile image into the given tile-sized buffer.
- * index supplies the index of the transparent image.
+/* Overlay a transparent tile image onto the tile-sized area of dest
+ * given by rect. index supplies the index of the transparent image.
  */
-static void addtransparenttile(Qt_Surface * dest, int id, int index)
+static void addtransparenttile(Qt_Surface * dest, TW_Rect const *rect,
+	int id, int index)
 {
-	Qt_Surface *src;
-	TW_Rect rect(0, 0, geng.wtile, geng.htile);
+	TW_Rect src = celrects[tileptr[id].transp[index]];
 
-	src = tileptr[id].transp[index];
 	if (tileptr[id].transpsize & SIZE_EXTLEFT)
-		rect.x += geng.wtile;
+		src.x += geng.wtile;
 	if (tileptr[id].transpsize & SIZE_EXTUP)
-		rect.y += geng.htile;
-	Qt_Surface::BlitSurface(src, &rect, dest, NULL);
+		src.y += geng.htile;
+	src.w = geng.wtile;
+	src.h = geng.htile;
+	Qt_Surface::BlitSurface(atlas, &src, dest, rect);
+}
+
+/* Empty the cache of composited cell images.
+ */
+static void resetcellcache(void)
+{
+	int n;
+
+	for (n = 0; n < CELLCACHE_SIZE; ++n) {
+		cachedcells[n].id = 0;
+		cachedcells[n].prev = n - 1;
+		cachedcells[n].next = n + 1 < CELLCACHE_SIZE ? n + 1 : -1;
+		cachedcells[n].hashnext = -1;
+	}
+	for (n = 0; n < CELLCACHE_BUCKETS; ++n)
+		cellcachebuckets[n] = -1;
+	cellcachefirst = 0;
+	cellcachelast = CELLCACHE_SIZE - 1;
+}
+
+/* Return the area of the cache surface used by the given entry.
+ */
+static TW_Rect cachedcellrect(int n)
+{
+	return TW_Rect((n % CELLCACHE_COLUMNS) * geng.wtile,
+		(n / CELLCACHE_COLUMNS) * geng.htile, geng.wtile, geng.htile);
 }
 
-/* Return a surface for the given creature or animation. rect is
- * assumed to point to an "integral" tile location, so if moving is
- * non-zero, the dir and moving values are used to adjust rect to
- * point to the exact mid-tile position. rect is also adjusted
- * appropriately when the creature's image is larger than a single
- * tile.
+/* Return the surface and source rectangle for an image of the
+ * transparent cel nt of top over cel nb of bot. The image is composed
+ * in the cache if it is not already there, replacing the least
+ * recently used entry.
  */
-static Qt_Surface *getcreatureimage(TW_Rect *rect,
+static Qt_Surface *getcompositecell(TW_Rect * src,
+					 int top, int nt, int bot, int nb)
+{
+	unsigned long id;
+	cachedcell *c;
+	TW_Rect rect;
+	short *link;
+	int bucket, n;
+
+	id = cellid(top, nt, bot, nb);
+	bucket = cellbucket(id);
+	for (n = cellcachebuckets[bucket]; n >= 0; n = cachedcells[n].hashnext)
+		if (cachedcells[n].id == id)
+			break;
+
+	if (n < 0) {
+		n = cellcachelast;
+		c = &cachedcells[n];
+		if (c->id) {
+			link = &cellcachebuckets[cellbucket(c->id)];
+			while (*link != n)
+				link = &cachedcells[*link].hashnext;
+			*link = c->hashnext;
+		}
+		c->id = id;
+		c->hashnext = cellcachebuckets[bucket];
+		cellcachebuckets[bucket] = n;
+
+		rect = cachedcellrect(n);
+		cellcache->FillRect(&rect, TW_MapRGB(0, 0, 0));
+		cellcache->BeginBatch();
+		if (tileptr[bot].opaque[nb]) {
+			TW_Rect botrect = celrects[tileptr[bot].opaque[nb]];
+			botrect.w = geng.wtile;
+			botrect.h = geng.htile;
+			Qt_Surface::BlitSurface(atlas, &botrect, cellcache, &rect);
+		} else {
+			Qt_Surface::BlitSurface(atlas, &celrects[tileptr[Empty].opaque[0]],
+				cellcache, &rect);
+			addtransparenttile(cellcache, &rect, bot, nb);
+		}
+		addtransparenttile(cellcache, &rect, top, nt);
+		cellcache->EndBatch();
+	}
+
+	c = &cachedcells[n];
+	if (n != cellcachefirst) {
+		cachedcells[c->prev].next = c->next;
+		if (c->next >= 0)
+			cachedcells[c->next].prev = c->prev;
+		else
+			cellcachelast = c->prev;
+		c->prev = -1;
+		c->next = cellcachefirst;
+		cachedcells[cellcachefirst].prev = n;
+		cellcachefirst = n;
+	}
+
+	*src = cachedcellrect(n);
+	return cellcache;
+}
+
+/* Return the surface and source rectangle for the given creature or
+ * animation. rect is assumed to point to an "integral" tile location,
+ * so if moving is non-zero, the dir and moving values are used to
+ * adjust rect to point to the exact mid-tile position. rect is also
+ * adjusted appropriately when the creature's image is larger than a
+ * single tile.
+ */
+static Qt_Surface *getcreatureimage(TW_Rect *rect, TW_Rect *src,
 					 int id, int dir, int moving, int frame)
 {
-	Qt_Surface *s;
 	tilemap const *q;
 	int n;
 
@@ -308,22 +539,22 @@ static Qt_Surface *getcreatureimage(TW_Rect *rect,
 	if (n >= q->celcount)
 		die("requested cel #%d from a %d-cel sequence (%d+%d)",
 			n, q->celcount, id, diridx(dir));
-	s = q->transp[n] ? q->transp[n] : q->opaque[n];
+	*src = celrects[q->transp[n] ? q->transp[n] : q->opaque[n]];
 
-	rect->w = s->w;
-	rect->h = s->h;
-	return s;
+	rect->w = src->w;
+	rect->h = src->h;
+	return atlas;
 }
 
-/* Return an image of a cell with the given tiles. If the top tile is
- * transparent, the appropriate composite image is constructed in the
- * overlay buffer. (If the top tile is opaque but has transparent
- * pixels, the image returned is constructed in a private surface). If
+/* Return the surface and source rectangle for an image of a cell with
+ * the given tiles. Opaque tiles are returned directly from the atlas.
+ * If the top tile is transparent, or opaque with transparent pixels,
+ * the composite image is taken from the cache of composited cells. If
  * rect is not NULL, the width and height fields are filled in.
  */
-static Qt_Surface *getcellimage(TW_Rect * rect, int top, int bot, int timerval)
+static Qt_Surface *getcellimage(TW_Rect * rect, TW_Rect * src,
+					 int top, int bot, int timerval)
 {
-	Qt_Surface *dest;
 	int nt, nb;
 
 	if (!tileptr[top].celcount)
@@ -336,58 +567,55 @@ static Qt_Surface *getcellimage(TW_Rect * rect, int top, int bot, int timerval)
 
 	nt = (timerval + 1) % tileptr[top].celcount;
 	if (bot == Nothing || bot == Empty || !tileptr[top].transp[0]) {
-		if (tileptr[top].opaque[nt])
-			return tileptr[top].opaque[nt];
-		Qt_Surface::BlitSurface(tileptr[Empty].opaque[0], NULL, opaquetile, NULL);
-		addtransparenttile(opaquetile, top, nt);
-		return opaquetile;
+		if (tileptr[top].opaque[nt]) {
+			*src = celrects[tileptr[top].opaque[nt]];
+			src->w = geng.wtile;
+			src->h = geng.htile;
+			return atlas;
+		}
+		return getcompositecell(src, top, nt, Empty, 0);
 	}
 
 	if (!tileptr[bot].celcount)
 		die("map element %02X has no suitable image", bot);
 	nb = (timerval + 1) % tileptr[bot].celcount;
-	dest = tileptr[Overlay_Buffer].opaque[0];
-	if (tileptr[bot].opaque[nb]) {
-		Qt_Surface::BlitSurface(tileptr[bot].opaque[nb], NULL, dest, NULL);
-	} else {
-		Qt_Surface::BlitSurface(tileptr[Empty].opaque[0], NULL, dest, NULL);
-		addtransparenttile(dest, bot, nb);
-	}
-	addtransparenttile(dest, top, nt);
-
-	return dest;
+	return getcompositecell(src, top, nt, bot, nb);
 }
 
 /* Get a generic tile image.
  */
-#define	gettileimage(id)	(getcellimage(NULL, (id), Empty, -1))
+#define	gettileimage(src, id)	(getcellimage(NULL, (src), (id), Empty, -1))
 
 /*
  * Tile rendering functions.
  */
 
-/* Copy a single tile to the position (xpos, ypos).
+/* Copy the area src of the surface s to the position (xpos, ypos).
  */
 static void drawfulltile(Qt_Surface * dest, int xpos, int ypos,
-	Qt_Surface * src)
+	Qt_Surface * s, TW_Rect const *src)
 {
 	TW_Rect rect(xpos, ypos, src->w, src->h);
 
-	Qt_Surface::BlitSurface(src, NULL, dest, &rect);
+	Qt_Surface::BlitSurface(s, src, dest, &rect);
 }
 
 /* Draw a tile of the given id at the position (xpos, ypos).
  */
 void drawfulltileid(Qt_Surface * dest, int xpos, int ypos, int id)
 {
-	drawfulltile(dest, xpos, ypos, gettileimage(id));
+	Qt_Surface *s;
+	TW_Rect src;
+
+	s = gettileimage(&src, id);
+	drawfulltile(dest, xpos, ypos, s, &src);
 }
 
-/* Copy a tile to the position (xpos, ypos) but clipped to the
- * displayloc rectangle.
+/* Copy the area src of the surface s to the position (xpos, ypos) but
+ * clipped to the displayloc rectangle.
  */
-static void drawclippedtile(TW_Rect const *rect, Qt_Surface * src,
-	TW_Rect displayloc)
+static void drawclippedtile(TW_Rect const *rect, Qt_Surface * s,
+	TW_Rect const *src, TW_Rect displayloc)
 {
 	int xoff, yoff, w, h;
 
@@ -407,28 +635,146 @@ static void drawclippedtile(TW_Rect const *rect, Qt_Surface * src,
 		return;
 
 	{
-		TW_Rect srect(xoff, yoff, w, h);
+		TW_Rect srect(src->x + xoff, src->y + yoff, w, h);
 		TW_Rect drect(rect->x + xoff, rect->y + yoff, 0, 0);
-		Qt_Surface::BlitSurface(src, &srect, geng.screen, &drect);
+		Qt_Surface::BlitSurface(s, &srect, geng.screen, &drect);
 	}
 }
 
 extern bool pedanticmode;
 
+/* A creature image drawn on the map view.
+ */
+typedef struct tiledraw {
+	TW_Rect src;				/* the area of the atlas drawn */
+	TW_Rect dest;				/* where it was drawn, before clipping */
+	bool redraw;				/* TRUE if drawn again this frame */
+} tiledraw;
+
+/* What the last call to displaymapview() left on the display, so that
+ * the next call can redraw only what has changed. lastcells holds an
+ * identifier of the image shown in each cell, and lastdraws lists the
+ * creatures drawn on top of the cells, in drawing order. lastviewvalid
+ * is FALSE when the display must be redrawn in full.
+ */
+static bool lastviewvalid = false;
+static Qt_Surface *lastscreen = NULL;
+static TW_Rect lastdisploc;
+static unsigned long lastcells[CXGRID * CYGRID];
+static tiledraw *lastdraws = NULL;
+static tiledraw *curdraws = NULL;
+static int lastdrawcount = 0;
+static int drawsallocated = 0;
+
+/* The cells to be redrawn in the current frame, and their images.
+ */
+static bool dirtycells[CXGRID * CYGRID];
+static Qt_Surface *cellsurfaces[CXGRID * CYGRID];
+static TW_Rect cellsources[CXGRID * CYGRID];
+
+/* Return a value identifying the image that getcellimage() produces
+ * for the given tiles.
+ */
+static unsigned long cellimageid(int top, int bot, int timerval)
+{
+	int nt, nb;
+
+	nt = tileptr[top].celcount ? (timerval + 1) % tileptr[top].celcount : 0;
+	if (bot == Nothing || bot == Empty || !tileptr[top].transp[0]) {
+		bot = Empty;
+		nb = 0;
+	} else {
+		nb = tileptr[bot].celcount ? (timerval + 1) % tileptr[bot].celcount : 0;
+	}
+	return cellid(top, nt, bot, nb);
+}
+
+/* Return the range of map columns or rows covered by the pixels from
+ * pos to pos + size - 1, given the position and size of the tiles and
+ * the number of them in the map.
+ */
+static void cellspan(int pos, int size, int origin, int tile, int count,
+	int *first, int *last)
+{
+	pos -= origin;
+	*first = pos >= 0 ? pos / tile : -((tile - 1 - pos) / tile);
+	pos += size - 1;
+	*last = pos >= 0 ? pos / tile : -((tile - 1 - pos) / tile);
+	if (*first < 0)
+		*first = 0;
+	if (*last >= count)
+		*last = count - 1;
+}
+
+/* Mark every cell under rect as needing to be redrawn. TRUE is
+ * returned if any of them were not already marked.
+ */
+static bool markdirty(TW_Rect const *rect, int xorigin, int yorigin)
+{
+	int x0, x1, y0, y1, x, y;
+	bool marked = false;
+
+	cellspan(rect->x, rect->w, xorigin, geng.wtile, CXGRID, &x0, &x1);
+	cellspan(rect->y, rect->h, yorigin, geng.htile, CYGRID, &y0, &y1);
+	for (y = y0; y <= y1; ++y) {
+		for (x = x0; x <= x1; ++x) {
+			if (!dirtycells[y * CXGRID + x]) {
+				dirtycells[y * CXGRID + x] = true;
+				marked = true;
+			}
+		}
+	}
+	return marked;
+}
+
+/* Return TRUE if any cell under rect is to be redrawn.
+ */
+static bool isdirty(TW_Rect const *rect, int xorigin, int yorigin)
+{
+	int x0, x1, y0, y1, x, y;
+
+	cellspan(rect->x, rect->w, xorigin, geng.wtile, CXGRID, &x0, &x1);
+	cellspan(rect->y, rect->h, yorigin, geng.htile, CYGRID, &y0, &y1);
+	for (y = y0; y <= y1; ++y)
+		for (x = x0; x <= x1; ++x)
+			if (dirtycells[y * CXGRID + x])
+				return true;
+	return false;
+}
+
+/* Return TRUE if the two creature images are identical.
+ */
+static bool samedraw(tiledraw const *a, tiledraw const *b)
+{
+	return a->src.x == b->src.x && a->src.y == b->src.y
+		&& a->src.w == b->src.w && a->src.h == b->src.h
+		&& a->dest.x == b->dest.x && a->dest.y == b->dest.y;
+}
+
 /* Render the view of the visible area of the map to the display, with
  * the view position centered on the display as much as possible. The
  * gamestate's map and the list of creatures are consulted to
- * determine what to render.
+ * determine what to render. All of the tiles are drawn in one batch.
+ *
+ * Only the parts of the view that differ from the previous call are
+ * redrawn: the cells whose images have changed, and the cells under
+ * any creature that has appeared, moved, changed or disappeared. Any
+ * other creature overlapping a redrawn cell is redrawn as well, along
+ * with the rest of the cells under it. The whole view is redrawn
+ * whenever it scrolls, or the display or the tile set changes.
  */
 void displaymapview(gamestate const *state, TW_Rect displayloc)
 {
-	TW_Rect rect;
-	Qt_Surface *s;
+	TW_Rect rect, src;
 	creature const *cr;
+	tiledraw *draws;
+	unsigned long id;
 	int xdisppos, ydisppos;
 	int xorigin, yorigin;
 	int lmap, tmap, rmap, bmap;
+	int timerval, drawcount, n, m, next;
 	int pos, x, y;
+	bool full, more;
 
 	xdisppos = state->xviewpos / 2 - (NXTILES / 2) * 4;
 	ydisppos = state->yviewpos / 2 - (NYTILES / 2) * 4;
@@ -443,8 +789,16 @@ void displaymapview(gamestate const *state, TW_Rect displayloc)
 	xorigin = displayloc.x - (xdisppos * geng.wtile / 4);
 	yorigin = displayloc.y - (ydisppos * geng.htile / 4);
 
+	full = !lastviewvalid || geng.screen != lastscreen
+		|| geng.mapvieworigin != ydisppos * CXGRID * 4 + xdisppos
+		|| displayloc.x != lastdisploc.x || displayloc.y != lastdisploc.y
+		|| displayloc.w != lastdisploc.w || displayloc.h != lastdisploc.h;
+
 	geng.mapvieworigin = ydisppos * CXGRID * 4 + xdisppos;
 
+	memset(dirtycells, full, sizeof dirtycells);
+	timerval = (state->statusflags & SF_NOANIMATION) ? -1 : state->currenttime;
+
 	lmap = xdisppos / 4;
 	tmap = ydisppos / 4;
 	rmap = (xdisppos + 3) / 4 + NXTILES;
@@ -456,21 +810,25 @@ void displaymapview(gamestate const *state, TW_Rect displayloc)
 			if (x < 0 || x >= CXGRID)
 				continue;
 			pos = y * CXGRID + x;
-			rect.x = xorigin + x * geng.wtile;
-			rect.y = yorigin + y * geng.htile;
-			s = getcellimage(&rect,
-				state->map[pos].top.id,
-				state->map[pos].bot.id,
-				(state->statusflags & SF_NOANIMATION) ?
-				-1 : state->currenttime);
-			drawclippedtile(&rect, s, displayloc);
+			id = cellimageid(state->map[pos].top.id,
+				state->map[pos].bot.id, timerval);
+			if (id != lastcells[pos]) {
+				lastcells[pos] = id;
+				dirtycells[pos] = true;
+			}
 		}
 	}
 
-	lmap -= 2;
-	tmap -= 2;
-	rmap += 2;
-	bmap += 2;
+	drawcount = 0;
+	for (cr = state->creatures; cr->id; ++cr)
+		++drawcount;
+	if (drawcount > drawsallocated) {
+		drawsallocated = drawcount;
+		x_type_alloc(tiledraw, lastdraws, drawsallocated * sizeof *lastdraws);
+		x_type_alloc(tiledraw, curdraws, drawsallocated * sizeof *curdraws);
+	}
+	draws = curdraws;
+	drawcount = 0;
 	for (cr = state->creatures; cr->id; ++cr) {
 		if (pedanticmode) {
 			if (cr->id == Ball && state->map[cr->pos].top.id == HintButton)
@@ -480,161 +838,248 @@ void displaymapview(gamestate const *state, TW_Rect displayloc)
 			continue;
 		x = cr->pos % CXGRID;
 		y = cr->pos / CXGRID;
-		if (x < lmap || x >= rmap || y < tmap || y >= bmap)
+		if (x < lmap - 2 || x >= rmap + 2 || y < tmap - 2 || y >= bmap + 2)
 			continue;
 		rect.x = xorigin + x * geng.wtile;
 		rect.y = yorigin + y * geng.htile;
-		s = getcreatureimage(&rect, cr->id, cr->dir, cr->moving, cr->frame);
-		drawclippedtile(&rect, s, displayloc);
+		getcreatureimage(&rect, &src, cr->id, cr->dir, cr->moving, cr->frame);
+		draws[drawcount].src = src;
+		draws[drawcount].dest = rect;
+		draws[drawcount].redraw = false;
+		++drawcount;
 	}
+
+	/* Match the creature images against the previous frame's, in
+	 * order. Anything without a match has changed, so the cells under
+	 * it, then or now, need redrawing.
+	 */
+	if (!full) {
+		next = 0;
+		for (n = 0; n < drawcount; ++n) {
+			for (m = next; m < lastdrawcount; ++m)
+				if (samedraw(&draws[n], &lastdraws[m]))
+					break;
+			if (m == lastdrawcount) {
+				markdirty(&draws[n].dest, xorigin, yorigin);
+				continue;
+			}
+			for ( ; next < m; ++next)
+				markdirty(&lastdraws[next].dest, xorigin, yorigin);
+			++next;
+		}
+		for ( ; next < lastdrawcount; ++next)
+			markdirty(&lastdraws[next].dest, xorigin, yorigin);
+	}
+
+	/* A creature over a redrawn cell has to be drawn again, and so all
+	 * of the cells under it have to be redrawn, which can in turn
+	 * uncover more creatures.
+	 */
+	do {
+		more = false;
+		for (n = 0; n < drawcount; ++n) {
+			if (draws[n].redraw || !isdirty(&draws[n].dest, xorigin, yorigin))
+				continue;
+			draws[n].redraw = true;
+			if (markdirty(&draws[n].dest, xorigin, yorigin))
+				more = true;
+		}
+	} while (more);
+
+	/* Find the cells' images before starting to draw, so that any
+	 * new composite images are made in the cache while none of it is
+	 * waiting to be drawn.
+	 */
+	for (y = tmap; y < bmap; ++y) {
+		if (y < 0 || y >= CXGRID)
+			continue;
+		for (x = lmap; x < rmap; ++x) {
+			if (x < 0 || x >= CXGRID)
+				continue;
+			pos = y * CXGRID + x;
+			if (dirtycells[pos])
+				cellsurfaces[pos] = getcellimage(NULL, &cellsources[pos],
+					state->map[pos].top.id,
+					state->map[pos].bot.id,
+					timerval);
+		}
+	}
+
+	geng.screen->BeginBatch();
+
+	for (y = tmap; y < bmap; ++y) {
+		if (y < 0 || y >= CXGRID)
+			continue;
+		for (x = lmap; x < rmap; ++x) {
+			if (x < 0 || x >= CXGRID)
+				continue;
+			pos = y * CXGRID + x;
+			if (!dirtycells[pos])
+				continue;
+			rect.x = xorigin + x * geng.wtile;
+			rect.y = yorigin + y * geng.htile;
+			rect.w = geng.wtile;
+			rect.h = geng.htile;
+			drawclippedtile(&rect, cellsurfaces[pos], &cellsources[pos],
+				displayloc);
+		}
+	}
+
+	for (n = 0; n < drawcount; ++n)
+		if (draws[n].redraw)
+			drawclippedtile(&draws[n].dest, atlas, &draws[n].src, displayloc);
+
+	geng.screen->EndBatch();
+
+	curdraws = lastdraws;
+	lastdraws = draws;
+	lastdrawcount = drawcount;
+	lastscreen = geng.screen;
+	lastdisploc = displayloc;
+	lastviewvalid = true;
 }
 
 /*
- * Functions for copying individual tiles.
+ * Functions for copying individual tiles into the atlas.
  */
 
-/* Create a new surface containing a single tile without any
- * transparent pixels.
+/* Add a new cel to the atlas containing a single tile without any
+ * transparent pixels, and return its index.
  */
-static Qt_Surface *extractopaquetile(Qt_Surface * src,
+static int extractopaquetile(Qt_Surface * src,
 	int ximg, int yimg, int wimg, int himg)
 {
-	Qt_Surface *dest = new Qt_Surface(wimg, himg, false);
-	TW_Rect rect(ximg, yimg, wimg, himg);
-
-	Qt_Surface::BlitSurface(src, &rect, dest, NULL);
-	return dest;
+	int cel = newcel(wimg, himg);
+	TW_Rect const *rect = &celrects[cel];
+	int y;
+
+	for (y = 0; y < himg; ++y)
+		memcpy(pixelat(atlas, rect->x, rect->y + y),
+			pixelat(src, ximg, yimg + y), wimg * sizeof(uint32_t));
+	return cel;
 }
 
-/* Create a new surface containing a single tile with transparent
- * pixels, as indicated by the given color key.
+/* Add a new cel to the atlas containing a single tile with
+ * transparent pixels, as indicated by the given color key, and return
+ * its index. As with color-keyed blits, the key is ignored if the
+ * source image has its own alpha channel.
  */
-static Qt_Surface *extractkeyedtile(Qt_Surface * src,
+static int extractkeyedtile(Qt_Surface * src,
 	int ximg, int yimg, int wimg, int himg, uint32_t transpclr)
 {
-	Qt_Surface *dest = new Qt_Surface(wimg, himg, true);
-	Qt_Surface *temp;
-
-	dest->FillRect(NULL, TW_MapRGBA(0, 0, 0, TW_ALPHA_TRANSPARENT));
-	src->SetColorKey(transpclr);
-	TW_Rect rect(ximg, yimg, dest->w, dest->h);
-
-	Qt_Surface::BlitSurface(src, &rect, dest, NULL);
-	src->ResetColorKey();
-
-	temp = dest;
-	dest = temp->DisplayFormat();
-	delete temp;
-	if (!dest)
-		die("unspecified error");
-	return dest;
+	int cel = extractopaquetile(src, ximg, yimg, wimg, himg);
+	TW_Rect const *rect = &celrects[cel];
+	uint32_t transp, *d;
+	int x, y;
+
+	if (src->HasAlphaChannel())
+		return cel;
+	transp = TW_MapRGBA(0, 0, 0, TW_ALPHA_TRANSPARENT);
+	for (y = 0; y < himg; ++y) {
+		d = pixelat(atlas, rect->x, rect->y + y);
+		for (x = 0; x < wimg; ++x)
+			d[x] = d[x] == transpclr ? transp : d[x];
+	}
+	return cel;
 }
 
-/* Create a new surface containing a single tile. Pixels with the
- * given transparent color are replaced with the corresponding pixels
- * from the empty tile.
+/* Add a new cel to the atlas containing a single tile, and return its
+ * index. Pixels with the given transparent color are replaced with
+ * the corresponding pixels from the empty tile.
  */
-static Qt_Surface *extractemptytile(Qt_Surface * src,
+static int extractemptytile(Qt_Surface * src,
 	int ximg, int yimg, int wimg, int himg, uint32_t transpclr)
 {
-	Qt_Surface *dest = new Qt_Surface(wimg, himg, false);
-	Qt_Surface *temp;
-
-	if (tileptr[Empty].opaque[0])
-		Qt_Surface::BlitSurface(tileptr[Empty].opaque[0], NULL, dest, NULL);
-	src->SetColorKey(transpclr);
-	TW_Rect rect(ximg, yimg, dest->w, dest->h);
-	Qt_Surface::BlitSurface(src, &rect, dest, NULL);
-	src->ResetColorKey();
-
-	temp = dest;
-	dest = temp->DisplayFormat();
-	delete temp;
-	if (!dest)
-		die("unspecified error");
-	return dest;
+	int cel = extractopaquetile(src, ximg, yimg, wimg, himg);
+	TW_Rect const *rect = &celrects[cel];
+	TW_Rect const *empty;
+	uint32_t black, *d, *e;
+	int x, y;
+
+	if (src->HasAlphaChannel())
+		return cel;
+	black = TW_MapRGB(0, 0, 0);
+	empty = tileptr[Empty].opaque[0] ? &celrects[tileptr[Empty].opaque[0]] : NULL;
+	for (y = 0; y < himg; ++y) {
+		d = pixelat(atlas, rect->x, rect->y + y);
+		if (empty) {
+			e = pixelat(atlas, empty->x, empty->y + y);
+			for (x = 0; x < wimg; ++x)
+				d[x] = d[x] == transpclr ? e[x] : d[x];
+		} else {
+			for (x = 0; x < wimg; ++x)
+				d[x] = d[x] == transpclr ? black : d[x];
+		}
+	}
+	return cel;
 }
 
-/* Create a new surface containing a single tile with transparent
- * pixels, as indicated by the mask tile.
+/* Add a new cel to the atlas containing a single tile with
+ * transparent pixels, as indicated by the mask tile, and return its
+ * index.
  */
-static Qt_Surface *extractmaskedtile(Qt_Surface * src,
+static int extractmaskedtile(Qt_Surface * src,
 	int ximg, int yimg, int wimg, int himg, int xmask, int ymask)
 {
-	Qt_Surface *temp;
-
-	unsigned char *d;
-	uint32_t transp, black;
+	int cel = extractopaquetile(src, ximg, yimg, wimg, himg);
+	TW_Rect const *rect = &celrects[cel];
+	uint32_t transp, black, *d, *m;
 	int x, y;
-	TW_Rect rect(ximg, yimg, wimg, himg);
-
-	Qt_Surface *dest = new Qt_Surface(rect.w, rect.h, true);
-	Qt_Surface::BlitSurface(src, &rect, dest, NULL);
 
 	black = TW_MapRGB(0, 0, 0);
 	transp = TW_MapRGBA(0, 0, 0, TW_ALPHA_TRANSPARENT);
 
-	src->SwitchToImage();
-	dest->SwitchToImage();
-
-	d = (uint8_t *) dest->pixels;
-	for (y = 0; y < dest->h; ++y) {
-		for (x = 0; x < dest->w; ++x) {
-			if (src->PixelAt(xmask + x, ymask + y) == black)
-				((uint32_t *) d)[x] = transp;
-		}
-		d += dest->pitch;
+	for (y = 0; y < himg; ++y) {
+		d = pixelat(atlas, rect->x, rect->y + y);
+		m = pixelat(src, xmask, ymask + y);
+		for (x = 0; x < wimg; ++x)
+			d[x] = m[x] == black ? transp : d[x];
 	}
-
-	temp = dest;
-	dest = temp->DisplayFormat();
-	delete temp;
-	if (!dest)
-		die("unspecified error");
-	return dest;
+	return cel;
 }
 
 /*
  * Reading the small format.
  */
 
-/* Transfer the tiles to the tileptr array, using tileidmap to
- * identify and locate the individual tile images. Any magenta pixels
- * in tiles that are allowed to have transparencies are made
- * transparent.
+/* Transfer the tiles to the atlas, using tileidmap to identify and
+ * locate the individual tile images, and fill in the tileptr array.
+ * Any magenta pixels in tiles that are allowed to have transparencies
+ * are made transparent.
  */
 static bool initsmalltileset(Qt_Surface * tiles)
 {
-	Qt_Surface *s;
+	int cel;
 	uint32_t magenta;
 
 	magenta = TW_MapRGB(255, 0, 255);
 
+	tiles->SwitchToImage();
+	startatlas(sizeof tileidmap / sizeof *tileidmap);
+
 	for (int n = 0; n < (int)(sizeof tileidmap / sizeof *tileidmap); ++n) {
 		int id = tileidmap[n].id;
-		tileptr[id].opaque[0] = NULL;
-		tileptr[id].transp[0] = NULL;
+		tileptr[id].opaque[0] = 0;
+		tileptr[id].transp[0] = 0;
 		tileptr[id].celcount = 0;
 		tileptr[id].transpsize = 0;
 		if (tileidmap[n].xtransp >= 0) {
-			s = extractkeyedtile(tiles, tileidmap[n].xopaque * geng.wtile,
+			cel = extractkeyedtile(tiles, tileidmap[n].xopaque * geng.wtile,
 				tileidmap[n].yopaque * geng.htile,
 				geng.wtile, geng.htile, magenta);
-			if (!s)
+			if (!cel)
 				return false;
-			remembersurface(s);
 			tileptr[id].celcount = 1;
-			tileptr[id].opaque[0] = NULL;
-			tileptr[id].transp[0] = s;
+			tileptr[id].opaque[0] = 0;
+			tileptr[id].transp[0] = cel;
 		} else if (tileidmap[n].xopaque >= 0) {
-			s = extractopaquetile(tiles, tileidmap[n].xopaque * geng.wtile,
+			cel = extractopaquetile(tiles, tileidmap[n].xopaque * geng.wtile,
 				tileidmap[n].yopaque * geng.htile, geng.wtile, geng.htile);
-			if (!s)
+			if (!cel)
 				return false;
-			remembersurface(s);
 			tileptr[id].celcount = 1;
-			tileptr[id].opaque[0] = s;
-			tileptr[id].transp[0] = NULL;
+			tileptr[id].opaque[0] = cel;
+			tileptr[id].transp[0] = 0;
 		}
 	}
 
@@ -645,44 +1090,45 @@ static bool initsmalltileset(Qt_Surface * tiles)
  * Reading the masked format.
  */
 
-/* Individually transfer the tiles to a one-dimensional array. The
- * black pixels in the maskimage are copied onto the indicated section
- * as transparent pixels. Then fill in the values of the tileptr
- * array, using tileidmap to identify the individual tile images.
+/* Individually transfer the tiles to the atlas. The black pixels in
+ * the maskimage are copied onto the indicated section as transparent
+ * pixels. Then fill in the values of the tileptr array, using
+ * tileidmap to identify the individual tile images.
  */
 static bool initmaskedtileset(Qt_Surface * tiles)
 {
-	Qt_Surface *s;
+	int cel;
 	int id, n;
 
+	tiles->SwitchToImage();
+	startatlas(2 * (sizeof tileidmap / sizeof *tileidmap));
+
 	for (n = 0; n < (int)(sizeof tileidmap / sizeof *tileidmap); ++n) {
 		id = tileidmap[n].id;
 		tileptr[id].celcount = 0;
-		tileptr[id].opaque[0] = NULL;
-		tileptr[id].transp[0] = NULL;
+		tileptr[id].opaque[0] = 0;
+		tileptr[id].transp[0] = 0;
 		tileptr[id].transpsize = 0;
 		if (tileidmap[n].xopaque >= 0) {
-			s = extractopaquetile(tiles, tileidmap[n].xopaque * geng.wtile,
+			cel = extractopaquetile(tiles, tileidmap[n].xopaque * geng.wtile,
 				tileidmap[n].yopaque * geng.htile, geng.wtile, geng.htile);
-			if (!s)
+			if (!cel)
 				return false;
-			remembersurface(s);
 			tileptr[id].celcount = 1;
-			tileptr[id].opaque[0] = s;
+			tileptr[id].opaque[0] = cel;
 		}
 		if (tileidmap[n].xtransp >= 0) {
-			s = extractmaskedtile(tiles,
+			cel = extractmaskedtile(tiles,
 				tileidmap[n].xtransp * geng.wtile,
 				tileidmap[n].ytransp * geng.htile,
 				geng.wtile,
 				geng.htile,
 				(tileidmap[n].xtransp + 3) * geng.wtile,
 				tileidmap[n].ytransp * geng.htile);
-			if (!s)
+			if (!cel)
 				return false;
-			remembersurface(s);
 			tileptr[id].celcount = 1;
-			tileptr[id].transp[0] = s;
+			tileptr[id].transp[0] = cel;
 		}
 	}
 
@@ -694,39 +1140,38 @@ static bool initmaskedtileset(Qt_Surface * tiles)
  */
 
 /* Copy a sequence of count tiles from the given surface at the
- * position indicated by rect into separate surfaces, stored in the
- * array at ptrs. transpclr indicates the color of the pixels to
- * replace with the corresponding pixels from the Empty tile.
+ * position indicated by rect into separate cels of the atlas, with
+ * their indexes stored in the array at cels. transpclr indicates the
+ * color of the pixels to replace with the corresponding pixels from
+ * the Empty tile.
  */
 static bool extractopaquetileseq(Qt_Surface * tiles, TW_Rect const *rect,
-	int count, Qt_Surface ** ptrs, uint32_t transpclr)
+	int count, short *cels, uint32_t transpclr)
 {
 	int x, n;
 
 	for (n = 0, x = rect->x; n < count; ++n, x += rect->w) {
-		ptrs[n] = extractemptytile(tiles, x, rect->y, rect->w, rect->h, transpclr);
-		if (!ptrs[n])
+		cels[n] = extractemptytile(tiles, x, rect->y, rect->w, rect->h, transpclr);
+		if (!cels[n])
 			return false;
-		remembersurface(ptrs[n]);
 	}
 	return true;
 }
 
 /* Copy a sequence of count tiles from the given surface at the
- * position indicated by rect into separate surfaces, stored in the
- * array at ptrs. transpclr indicates the color of the pixels to make
- * transparent.
+ * position indicated by rect into separate cels of the atlas, with
+ * their indexes stored in the array at cels. transpclr indicates the
+ * color of the pixels to make transparent.
  */
 static bool extracttransptileseq(Qt_Surface * tiles, TW_Rect const *rect,
-	int count, Qt_Surface ** ptrs, uint32_t transpclr)
+	int count, short *cels, uint32_t transpclr)
 {
 	int x, n;
 
 	for (n = count - 1, x = rect->x; n >= 0; --n, x += rect->w) {
-		ptrs[n] = extractkeyedtile(tiles, x, rect->y, rect->w, rect->h, transpclr);
-		if (!ptrs[n])
+		cels[n] = extractkeyedtile(tiles, x, rect->y, rect->w, rect->h, transpclr);
+		if (!cels[n])
 			return false;
-		remembersurface(ptrs[n]);
 	}
 	return true;
 }
@@ -734,10 +1179,8 @@ static bool extracttransptileseq(Qt_Surface * tiles, TW_Rect const *rect,
 /* Extract the tile images for a single tile type from the given
  * surface at the given coordinates. shape identifies the arrangement
  * of tile image(s) that may be present. transpclr indicates the color
- * of the pixels that are to be treated as transparent. pd points to a
- * pointer to the buffer where the tile images are to be copied. Upon
- * return, the pointer at pd is updated to point to the first byte in
- * the buffer after the copied tile images.
+ * of the pixels that are to be treated as transparent. The tile
+ * images are copied into new cels of the atlas.
  */
 static bool extracttileimage(Qt_Surface * tiles, int x, int y, int w, int h,
 	int id, int shape, uint32_t transpclr)
@@ -936,6 +1379,67 @@ static bool extracttileimage(Qt_Surface * tiles, int x, int y, int w, int h,
 	return true;
 }
 
+/* Make the atlas used for drawing match displaytilesize, by scaling
+ * each cel of the native atlas separately (so that no cel's edges
+ * pick up pixels from its neighbors). Since every cel is a whole
+ * number of tiles in size and position, the scaled cels keep the same
+ * arrangement. FALSE is returned if the tile size was already right.
+ */
+static bool scaleatlas(void)
+{
+	TW_Rect const *r;
+	int w, h, n;
+
+	w = nativewtile;
+	h = nativehtile;
+	if (displaytilesize > 0) {
+		n = w > h ? w : h;
+		w = w * displaytilesize / n;
+		h = h * displaytilesize / n;
+		w = w < 4 ? 4 : w - w % 4;
+		h = h < 4 ? 4 : h - h % 4;
+	}
+	if (atlas && w == geng.wtile && h == geng.htile)
+		return false;
+
+	if (atlas != nativeatlas)
+		delete atlas;
+	resetcellcache();
+	lastviewvalid = false;
+	settilesize(w, h);
+
+	if (w == nativewtile && h == nativehtile) {
+		atlas = nativeatlas;
+		memcpy(celrects, nativerects, celsused * sizeof *celrects);
+	} else {
+		atlas = new Qt_Surface(ATLAS_COLUMNS * w,
+			(nativeatlas->h / nativehtile) * h, true);
+		for (n = 1; n < celsused; ++n) {
+			r = &nativerects[n];
+			celrects[n] = TW_Rect(r->x / nativewtile * w, r->y / nativehtile * h,
+				r->w / nativewtile * w, r->h / nativehtile * h);
+			Qt_Surface::ScaleSurface(nativeatlas, r, atlas, &celrects[n]);
+		}
+	}
+	atlas->SwitchToPixmap();
+	return true;
+}
+
+/* Ready the atlas for drawing once all of the cels are in place. The
+ * loaded atlas is set aside as the native atlas, and a copy scaled to
+ * the display size takes its place if necessary.
+ */
+static void finishatlas(void)
+{
+	x_type_alloc(TW_Rect, nativerects, celsused * sizeof *nativerects);
+	memcpy(nativerects, celrects, celsused * sizeof *celrects);
+	nativeatlas = atlas;
+	nativewtile = geng.wtile;
+	nativehtile = geng.htile;
+	atlas = NULL;
+	scaleatlas();
+}
+
 /* Free all memory allocated for the current set of tile images.
  */
 static void freetileset(void)
@@ -946,33 +1450,121 @@ static void freetileset(void)
 		tileptr[n].celcount = 0;
 		tileptr[n].transpsize = 0;
 		for (m = 0; m < 16; ++m) {
-			tileptr[n].opaque[m] = NULL;
-			tileptr[n].transp[m] = NULL;
+			tileptr[n].opaque[m] = 0;
+			tileptr[n].transp[m] = 0;
 		}
 	}
 	geng.wtile = 0;
 	geng.htile = 0;
-	opaquetile = NULL;
-	freerememberedsurfaces();
+	delete cellcache;
+	cellcache = NULL;
+	resetcellcache();
+	if (atlas != nativeatlas)
+		delete atlas;
+	atlas = NULL;
+	delete nativeatlas;
+	nativeatlas = NULL;
+	free(nativerects);
+	nativerects = NULL;
+	nativewtile = 0;
+	nativehtile = 0;
+	lastviewvalid = false;
+	free(lastdraws);
+	lastdraws = NULL;
+	free(curdraws);
+	curdraws = NULL;
+	lastdrawcount = 0;
+	drawsallocated = 0;
+	free(celrects);
+	celrects = NULL;
+	celsused = 0;
+	celsallocated = 0;
+	free(tilesetname);
+	tilesetname = NULL;
+}
+
+/* Free the spare tile set, leaving it empty. Nothing is created, so
+ * this is safe to call while the program is shutting down.
+ */
+static void freesparetileset(void)
+{
+	if (spare.atlas != spare.nativeatlas)
+		delete spare.atlas;
+	delete spare.nativeatlas;
+	free(spare.nativerects);
+	free(spare.celrects);
+	free(spare.filename);
+	memset(&spare, 0, sizeof spare);
+}
+
+/* Exchange the current tile set with the spare one.
+ */
+static void swaptileset(void)
+{
+	residenttileset cur;
+
+	cur.filename = tilesetname;
+	memcpy(cur.tileptr, tileptr, sizeof tileptr);
+	cur.atlas = atlas;
+	cur.celrects = celrects;
+	cur.celsused = celsused;
+	cur.celsallocated = celsallocated;
+	cur.nativeatlas = nativeatlas;
+	cur.nativerects = nativerects;
+	cur.nativewtile = nativewtile;
+	cur.nativehtile = nativehtile;
+	cur.wtile = geng.wtile;
+	cur.htile = geng.htile;
+
+	tilesetname = spare.filename;
+	memcpy(tileptr, spare.tileptr, sizeof tileptr);
+	atlas = spare.atlas;
+	celrects = spare.celrects;
+	celsused = spare.celsused;
+	celsallocated = spare.celsallocated;
+	nativeatlas = spare.nativeatlas;
+	nativerects = spare.nativerects;
+	nativewtile = spare.nativewtile;
+	nativehtile = spare.nativehtile;
+	geng.wtile = spare.wtile;
+	geng.htile = spare.htile;
+	spare = cur;
+
+	resetcellcache();
+	lastviewvalid = false;
+	delete cellcache;
+	cellcache = NULL;
+	if (atlas)
+		settilesize(geng.wtile, geng.htile);
+}
+
+/* Set the current tile set aside as the spare, so that a new one can
+ * be loaded in its place. The previous spare is freed.
+ */
+static void sparetileset(void)
+{
+	freesparetileset();
+	swaptileset();
+	freetileset();
 }
 
 /* Extract the large-format tile images from the given surface. The
  * surface is scanned to find the delimiter pixels. Upon return, the
- * pointers to each tile image is stored in the appropriate field of
+ * atlas cels of each tile image are stored in the appropriate field of
  * the tileptr array.
  */
 static bool initlargetileset(Qt_Surface * tiles)
 {
 	TW_Rect *tilepos = NULL;
 	uint32_t transpclr;
-	int row, nextrow;
+	int row, nextrow, count;
 	int n, x, y, w, h;
 
 	tiles->SwitchToImage();
 
-	transpclr = tiles->PixelAt(1, 0);
+	transpclr = *pixelat(tiles, 1, 0);
 	for (w = 1; w < tiles->w; ++w)
-		if (tiles->PixelAt(w, 0) != transpclr)
+		if (*pixelat(tiles, w, 0) != transpclr)
 			break;
 	if (w == tiles->w) {
 		warn("Can't find tile separators");
@@ -983,7 +1575,7 @@ static bool initlargetileset(Qt_Surface * tiles)
 		return false;
 	}
 	for (h = 1; h < tiles->h; ++h)
-		if (tiles->PixelAt(0, h) != transpclr)
+		if (*pixelat(tiles, 0, h) != transpclr)
 			break;
 	--h;
 	if (h % 4 != 0) {
@@ -996,6 +1588,7 @@ static bool initlargetileset(Qt_Surface * tiles)
 
 	x_type_alloc(TW_Rect, tilepos, (sizeof tileidmap / sizeof *tileidmap) * sizeof *tilepos);
 
+	count = 2;
 	row = 0;
 	nextrow = geng.htile + 1;
 	h = 1;
@@ -1012,7 +1605,7 @@ static bool initlargetileset(Qt_Surface * tiles)
 				w = 0;
 				break;
 			}
-			if (tiles->PixelAt(x + w * geng.wtile, row) != transpclr)
+			if (*pixelat(tiles, x + w * geng.wtile, row) != transpclr)
 				break;
 		}
 		if (!w) {
@@ -1027,7 +1620,7 @@ static bool initlargetileset(Qt_Surface * tiles)
 					break;
 				}
 				nextrow += geng.htile;
-			} while (tiles->PixelAt(0, nextrow) == transpclr);
+			} while (*pixelat(tiles, 0, nextrow) == transpclr);
 			if (!h) {
 				warn("incomplete tile set: missing %02X", tileidmap[n].id);
 				goto failure;
@@ -1039,15 +1632,16 @@ static bool initlargetileset(Qt_Surface * tiles)
 		tilepos[n].y = y + 1;
 		tilepos[n].w = w;
 		tilepos[n].h = h;
+		count += w * h;
 		x += w * geng.wtile;
 	}
 
+	startatlas(count);
 	tileptr[Empty].transpsize = 0;
 	tileptr[Empty].celcount = 1;
 	tileptr[Empty].opaque[0] = extractopaquetile(tiles, 1, 1,
 		geng.wtile, geng.htile);
-	tileptr[Empty].transp[0] = NULL;
-	remembersurface(tileptr[Empty].opaque[0]);
+	tileptr[Empty].transp[0] = 0;
 
 	for (n = 1; n < (int)(sizeof tileidmap / sizeof *tileidmap); ++n) {
 		if (tileidmap[n].shape == TILEIMG_IMPLICIT)
@@ -1063,7 +1657,7 @@ static bool initlargetileset(Qt_Surface * tiles)
 		TILEIMG_SINGLEOPAQUE, transpclr);
 	tileptr[Block_Static].celcount = 1;
 	tileptr[Block_Static].opaque[0] = tileptr[Block].transp[0];
-	tileptr[Block_Static].transp[0] = NULL;
+	tileptr[Block_Static].transp[0] = 0;
 	tileptr[HiddenWall_Perm] = tileptr[Empty];
 	tileptr[HiddenWall_Temp] = tileptr[Empty];
 	tileptr[BlueWall_Fake] = tileptr[BlueWall_Real];
@@ -1077,10 +1671,359 @@ static bool initlargetileset(Qt_Surface * tiles)
 	return false;
 }
 
+/*
+ * Caching decoded tile sets.
+ */
+
+/* The identifying string of a cached tile set, including the version
+ * of its format.
+ */
+#define	TILECACHE_MAGIC		"TWATLS1"
+
+/* The start of a cached tile set file. It is followed by the tileptr
+ * array, the cel rectangles, and then the rows of the native atlas.
+ * The fields up to tilemapsize identify the bitmap the cache was made
+ * from; the cache is only used if they all match.
+ */
+typedef struct tilecacheheader {
+	char		magic[8];	/* TILECACHE_MAGIC */
+	long long	size;		/* the size of the bitmap file */
+	long long	mtime;		/* the bitmap's modification time */
+	unsigned long long hash;	/* a hash of the bitmap's contents */
+	int		tilemapsize;	/* sizeof(tilemap) */
+	int		wtile;		/* the dimensions of a tile */
+	int		htile;
+	int		celsused;	/* the number of cel rectangles */
+	int		atlasw;		/* the dimensions of the atlas */
+	int		atlash;
+} tilecacheheader;
+
+/* Fill in the identifying fields of a cache header for the given
+ * bitmap file, and choose the name of its cache file. FALSE is
+ * returned if there is nowhere to keep the cache, or if the bitmap
+ * cannot be read.
+ */
+static bool tilecachekey(char const *filename, tilecacheheader *key,
+	char *cachename)
+{
+	unsigned char buf[16384];
+	struct stat st;
+	FILE *fp;
+	unsigned long long h;
+	unsigned long nh;
+	char const *p;
+	size_t i, n;
+
+	if (!getdir(CACHEDIR) || stat(filename, &st))
+		return false;
+	if (!(fp = fopen(filename, "rb")))
+		return false;
+	h = 14695981039346656037ULL;
+	while ((n = fread(buf, 1, sizeof buf, fp)) > 0)
+		for (i = 0; i < n; ++i)
+			h = (h ^ buf[i]) * 1099511628211ULL;
+	fclose(fp);
+
+	memset(key, 0, sizeof *key);
+	memcpy(key->magic, TILECACHE_MAGIC, sizeof key->magic);
+	key->size = st.st_size;
+	key->mtime = st.st_mtime;
+	key->hash = h;
+	key->tilemapsize = sizeof(tilemap);
+
+	nh = 2166136261UL;
+	for (p = filename; *p; ++p)
+		nh = ((nh ^ (unsigned char)*p) * 16777619UL) & 0xFFFFFFFFUL;
+	sprintf(cachename, "tiles-%08lx.cache", nh);
+	return true;
+}
+
+/* Return TRUE if the dimensions in a cache header are sane, and the
+ * cache file is exactly as large as they say it should be.
+ */
+static bool validtilecacheheader(tilecacheheader const *hdr, long long size)
+{
+	if (hdr->wtile < 4 || hdr->wtile > 1024 || hdr->wtile % 4
+			|| hdr->htile < 4 || hdr->htile > 1024 || hdr->htile % 4)
+		return false;
+	if (hdr->celsused < 1 || hdr->celsused > SHRT_MAX
+			|| hdr->atlasw < hdr->wtile || hdr->atlasw > 65536
+			|| hdr->atlash < hdr->htile || hdr->atlash > 65536)
+		return false;
+	return size == (long long)(sizeof *hdr + sizeof tileptr)
+		+ hdr->celsused * (long long)sizeof *celrects
+		+ hdr->atlasw * (long long)hdr->atlash * (long long)sizeof(uint32_t);
+}
+
+/* Return TRUE if every cel that the tile images refer to lies within
+ * the atlas, and is large enough to be drawn from. (Cel zero, which
+ * means no image, need only be empty.)
+ */
+static bool validtilecache(void)
+{
+	TW_Rect const *r;
+	int n, m, w, h;
+
+	if (celrects[0].w > 0 || celrects[0].h > 0)
+		return false;
+	for (n = 1; n < celsused; ++n) {
+		r = &celrects[n];
+		if (r->x < 0 || r->y < 0 || r->w < geng.wtile || r->h < geng.htile
+				|| r->w > atlas->w - r->x || r->h > atlas->h - r->y)
+			return false;
+	}
+	for (n = 0; n < NTILES; ++n) {
+		if (tileptr[n].celcount < 0 || tileptr[n].celcount > 16)
+			return false;
+		w = geng.wtile;
+		if (tileptr[n].transpsize & SIZE_EXTLEFT)
+			w += geng.wtile;
+		if (tileptr[n].transpsize & SIZE_EXTRIGHT)
+			w += geng.wtile;
+		h = geng.htile;
+		if (tileptr[n].transpsize & SIZE_EXTUP)
+			h += geng.htile;
+		if (tileptr[n].transpsize & SIZE_EXTDOWN)
+			h += geng.htile;
+		for (m = 0; m < 16; ++m) {
+			if (tileptr[n].opaque[m] < 0
+					|| tileptr[n].opaque[m] >= celsused
+					|| tileptr[n].transp[m] < 0
+					|| tileptr[n].transp[m] >= celsused)
+				return false;
+			if (tileptr[n].transp[m]
+					&& (celrects[tileptr[n].transp[m]].w < w
+					|| celrects[tileptr[n].transp[m]].h < h))
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Read a cached tile set made from the bitmap identified by key,
+ * checking that its header matches and is sane. The header is stored
+ * in hdr, and the rest of the file is returned in a newly allocated
+ * buffer, or NULL if there is no usable cache. Nothing else is
+ * touched, so this may be called from any thread.
+ */
+static unsigned char *readtilecache(char const *cachename,
+	tilecacheheader const *key, tilecacheheader *hdr)
+{
+	fileinfo file(CACHEDIR, cachename);
+	struct stat st;
+	char *path;
+	int r;
+
+	path = getpathforfileindir(CACHEDIR, cachename);
+	r = stat(path, &st);
+	free(path);
+	if (r || !file.open("rb", NULL))
+		return NULL;
+	if (!file.read(hdr, sizeof *hdr)
+			|| memcmp(hdr, key, offsetof(tilecacheheader, wtile))
+			|| !validtilecacheheader(hdr, st.st_size))
+		return NULL;
+	return file.readbuf(st.st_size - sizeof *hdr, NULL);
+}
+
+/* Make a cached tile set, as returned by readtilecache(), the (empty)
+ * current tile set. Everything in it is checked before it is used, so
+ * a damaged cache is rejected rather than trusted. FALSE is returned
+ * if the cache is not usable.
+ */
+static bool usetilecache(tilecacheheader const *hdr, unsigned char const *data)
+{
+	int y;
+
+	if (!settilesize(hdr->wtile, hdr->htile))
+		return false;
+	celsused = celsallocated = hdr->celsused;
+	x_type_alloc(TW_Rect, celrects, celsallocated * sizeof *celrects);
+	atlas = new Qt_Surface(hdr->atlasw, hdr->atlash, true);
+	memcpy(tileptr, data, sizeof tileptr);
+	data += sizeof tileptr;
+	memcpy(celrects, data, celsused * sizeof *celrects);
+	data += celsused * sizeof *celrects;
+	if (!validtilecache()) {
+		freetileset();
+		return false;
+	}
+	for (y = 0; y < atlas->h; ++y) {
+		memcpy(pixelat(atlas, 0, y), data, atlas->w * sizeof(uint32_t));
+		data += atlas->w * sizeof(uint32_t);
+	}
+	return true;
+}
+
+/* Write the current tile set to the given file in the cache
+ * directory. FALSE is returned if the file could not be written in
+ * full. The file is closed upon return either way.
+ */
+static bool writetilecachefile(char const *name, tilecacheheader const *hdr)
+{
+	fileinfo file(CACHEDIR, name);
+	int y;
+
+	if (!file.open("wb", NULL))
+		return false;
+	if (!file.write(hdr, sizeof *hdr)
+			|| !file.write(tileptr, sizeof tileptr)
+			|| !file.write(celrects, celsused * sizeof *celrects))
+		return false;
+	for (y = 0; y < atlas->h; ++y)
+		if (!file.write(pixelat(atlas, 0, y), atlas->w * sizeof(uint32_t)))
+			return false;
+	file.close();
+	return errno == 0;
+}
+
+/* Save the current tile set, which has just been decoded from the
+ * bitmap identified by key, so that it need not be decoded again.
+ * The cache is written under a temporary name and then renamed, so
+ * that it is never seen half-written. Failure to write the cache is
+ * not an error.
+ */
+static void writetilecache(char const *cachename, tilecacheheader const *key)
+{
+	tilecacheheader hdr = *key;
+	char tmpname[40];
+	char *tmppath, *path;
+	bool f;
+
+	hdr.wtile = geng.wtile;
+	hdr.htile = geng.htile;
+	hdr.celsused = celsused;
+	hdr.atlasw = atlas->w;
+	hdr.atlash = atlas->h;
+
+	sprintf(tmpname, "%s.tmp", cachename);
+	f = writetilecachefile(tmpname, &hdr);
+	tmppath = getpathforfileindir(CACHEDIR, tmpname);
+	path = getpathforfileindir(CACHEDIR, cachename);
+	if (f && rename(tmppath, path)) {
+		remove(path);
+		f = !rename(tmppath, path);
+	}
+	if (!f)
+		remove(tmppath);
+	free(tmppath);
+	free(path);
+}
+
+/*
+ * Reading tile sets ahead of time.
+ */
+
+/* A tile bitmap that has been read, and either its cache or its image
+ * decoded, but that has not yet been made into a tile set. The reading
+ * can be done on another thread; making the tile set cannot.
+ */
+typedef struct preparedtileset {
+	char	       *filename;
+	bool		cached;		/* TRUE if key and cachename are set */
+	tilecacheheader	key;
+	char		cachename[32];
+	tilecacheheader	hdr;		/* the header of the cache */
+	unsigned char  *cachedata;	/* the rest of the cache, or NULL */
+	QImage		image;		/* the bitmap, if cachedata is NULL */
+} preparedtileset;
+
+/* The tile bitmaps read ahead of time and not yet used. They are
+ * added to by whichever thread reads them, hence the lock.
+ */
+static std::vector<preparedtileset*> preparedtilesets;
+static std::mutex preparedlock;
+
+/* Read the given tile bitmap, or the cache made from it. Nothing but
+ * the returned structure is touched, so this may be called from any
+ * thread.
+ */
+static preparedtileset *readtileset(char const *filename)
+{
+	preparedtileset *p;
+
+	p = new preparedtileset;
+	x_cmalloc(p->filename, strlen(filename) + 1);
+	strcpy(p->filename, filename);
+	p->cachedata = NULL;
+	p->cached = tilecachekey(filename, &p->key, p->cachename);
+	if (p->cached)
+		p->cachedata = readtilecache(p->cachename, &p->key, &p->hdr);
+	if (!p->cachedata)
+		p->image = QImage(filename).convertToFormat(QImage::Format_ARGB32);
+	return p;
+}
+
+/* Free a prepared tile bitmap.
+ */
+static void freepreparedtileset(preparedtileset *p)
+{
+	free(p->filename);
+	free(p->cachedata);
+	delete p;
+}
+
+/* Remove the given bitmap from the ones read ahead of time, and
+ * return it, or NULL if it has not been read ahead.
+ */
+static preparedtileset *takepreparedtileset(char const *filename)
+{
+	std::lock_guard<std::mutex> hold(preparedlock);
+	preparedtileset *p;
+	size_t n;
+
+	for (n = 0; n < preparedtilesets.size(); ++n) {
+		p = preparedtilesets[n];
+		if (!strcmp(p->filename, filename)) {
+			preparedtilesets.erase(preparedtilesets.begin() + n);
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* Free all the bitmaps read ahead of time and never used.
+ */
+static void freepreparedtilesets(void)
+{
+	std::lock_guard<std::mutex> hold(preparedlock);
+
+	for (preparedtileset *p : preparedtilesets)
+		freepreparedtileset(p);
+	preparedtilesets.clear();
+}
+
+/* Free the current and the spare tile sets, and any bitmaps read
+ * ahead of time.
+ */
+static void freetilesets(void)
+{
+	freepreparedtilesets();
+	freesparetileset();
+	freetileset();
+}
+
 /*
  * The exported functions.
  */
 
+/* Read the given tile bitmap ahead of time, so that a later call to
+ * loadtileset() for the same file need not read or decode it. This
+ * may be called from any thread, and displays no errors. FALSE is
+ * returned if the bitmap could not be read.
+ */
+bool preparetileset(char const *filename)
+{
+	preparedtileset *p;
+	bool f;
+
+	p = readtileset(filename);
+	f = p->cachedata || !p->image.isNull();
+	std::lock_guard<std::mutex> hold(preparedlock);
+	preparedtilesets.push_back(p);
+	return f;
+}
+
 /* Load the set of tile images stored in the given bitmap. Error
  * messages will be displayed if complain is TRUE. The return value is
  * TRUE if the tiles were successfully identified and loaded into
@@ -1088,38 +2031,83 @@ static bool initlargetileset(Qt_Surface * tiles)
  */
 bool loadtileset(char const *filename, bool complain)
 {
-	Qt_Surface *tiles = new Qt_Surface(filename);
+	preparedtileset *prep;
+	Qt_Surface *tiles;
 	bool f;
 	int w, h;
 
-	if (!tiles) {
-		if (complain)
-			warn("%s: cannot read bitmap: unspecified error", filename);
-		return false;
+	prep = takepreparedtileset(filename);
+	if ((tilesetname && !strcmp(tilesetname, filename))
+			|| (spare.filename && !strcmp(spare.filename, filename))) {
+		if (prep)
+			freepreparedtileset(prep);
+		if (!tilesetname || strcmp(tilesetname, filename)) {
+			swaptileset();
+			scaleatlas();
+		}
+		return true;
 	}
+	if (!prep)
+		prep = readtileset(filename);
 
-	if (tiles->w % 2 != 0) {
-		freetileset();
-		f = initlargetileset(tiles);
-	} else if (tiles->w % 13 == 0 && tiles->h % 16 == 0) {
-		w = tiles->w / 13;
-		h = tiles->h / 16;
-		freetileset();
-		f = settilesize(w, h) && initmaskedtileset(tiles);
-	} else if (tiles->w % 7 == 0 && tiles->h % 16 == 0) {
-		w = tiles->w / 7;
-		h = tiles->h / 16;
-		freetileset();
-		f = settilesize(w, h) && initsmalltileset(tiles);
+	sparetileset();
+	if (prep->cachedata && usetilecache(&prep->hdr, prep->cachedata)) {
+		f = true;
 	} else {
-		if (complain)
-			warn("%s: image file has invalid dimensions (%dx%d)", filename,
-				tiles->w, tiles->h);
-		f = false;
+		if (prep->cachedata)
+			tiles = new Qt_Surface(filename);
+		else
+			tiles = new Qt_Surface(prep->image);
+		if (!tiles->w || !tiles->h) {
+			if (complain)
+				warn("%s: cannot read bitmap: unspecified error", filename);
+			f = false;
+		} else if (tiles->w % 2 != 0) {
+			freetileset();
+			f = initlargetileset(tiles);
+		} else if (tiles->w % 13 == 0 && tiles->h % 16 == 0) {
+			w = tiles->w / 13;
+			h = tiles->h / 16;
+			freetileset();
+			f = settilesize(w, h) && initmaskedtileset(tiles);
+		} else if (tiles->w % 7 == 0 && tiles->h % 16 == 0) {
+			w = tiles->w / 7;
+			h = tiles->h / 16;
+			freetileset();
+			f = settilesize(w, h) && initsmalltileset(tiles);
+		} else {
+			if (complain)
+				warn("%s: image file has invalid dimensions (%dx%d)", filename,
+					tiles->w, tiles->h);
+			f = false;
+		}
+		if (f && prep->cached)
+			writetilecache(prep->cachename, &prep->key);
+		delete tiles;
 	}
+	freepreparedtileset(prep);
 
-	delete tiles;
-	return f;
+	if (!f) {
+		swaptileset();
+		return false;
+	}
+	finishatlas();
+	x_cmalloc(tilesetname, strlen(filename) + 1);
+	strcpy(tilesetname, filename);
+	return true;
+}
+
+/* Scale the current tile set, and any tile set loaded afterwards, so
+ * that its tiles fit within a square of the given size. A size of
+ * zero restores the tile set's native size. TRUE is returned if the
+ * size of the tiles has changed.
+ */
+bool scaletileset(int size)
+{
+	displaytilesize = size;
+	if (!nativeatlas)
+		return false;
+	return scaleatlas();
 }
 
 /* Initialization.
@@ -1127,5 +2115,5 @@ bool loadtileset(char const *filename, bool complain)
 void tileinitialize()
 {
 	geng.mapvieworigin = -1;
-	atexit(freetileset);
+	atexit(freetilesets);
 }
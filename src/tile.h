@@ -35,8 +35,24 @@ extern void drawfulltileid(Qt_Surface *dest, int xpos, int ypos, int id);
 /* Extract the tile images stored in the given file and use them as
  * the current tile set. FALSE is returned if the attempt was
  * unsuccessful. If complain is FALSE, no error messages will be
- * displayed.
+ * displayed. The tile set being replaced is kept in memory, so that
+ * switching back to it does not reread its file.
  */
 extern bool loadtileset(char const *filename, bool complain);
 
+/* Read and decode the given tile bitmap ahead of time, so that
+ * loadtileset() can use it without doing so itself. Unlike the other
+ * functions here, this may be called from any thread. No error
+ * messages are displayed. FALSE is returned if the file could not be
+ * read.
+ */
+extern bool preparetileset(char const *filename);
+
+/* Scale the tile images, now and in any tile set loaded later, so
+ * that each tile fits within a square of size pixels. Zero selects
+ * the tile set's own size. TRUE is returned if the size of the tiles
+ * has changed, in which case surfaces sized in tiles must be remade.
+ */
+extern bool scaletileset(int size);
+
 #endif
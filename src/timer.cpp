@@ -7,41 +7,93 @@
 #include	<QThread>
 #include	<QElapsedTimer>
 
+#include	<atomic>
 #include	<cstdlib>
+#include	<cstdio>
 
 #include	"defs.h"
 #include	"timer.h"
+#include	"profile.h"
 
 /* QElapsedTimer object
  */
 static QElapsedTimer qtimer;
 
 /* By default, a second of game time lasts for 1000 milliseconds of
- * real time.
+ * real time. Times are kept in nanoseconds, so that the MS ruleset's
+ * 55 ms tick is exact. The speed settings may be changed by the user
+ * interface while another thread is waiting on the timer.
  */
-static int	mspertick = 1000 / TICKS_PER_SECOND;
+static std::atomic<qint64>	nspertick(1000000000 / TICKS_PER_SECOND);
 
 /* The tick counter.
  */
 static int	utick = 0;
 
-/* The time of the next tick.
+/* The time of the next tick. Deadlines advance by exactly one tick
+ * each time, regardless of when the program actually woke up, so
+ * that errors do not accumulate.
  */
-static int	nexttickat = 0;
+static qint64	nexttickat = 0;
 
-/* A histogram of how many milliseconds the program spends sleeping
- * per tick.
+/* The minimum time between frames under turbo timing, or zero if
+ * turbo timing is off, whether waitfortick() last ran under turbo
+ * timing, and the time that the next frame is due.
  */
-#ifndef NDEBUG
-static unsigned	hist[100];
-#endif
+static std::atomic<int>	turboframems(0);
+static bool	inturbo = false;
+static qint64	nextframeat = 0;
+
+/* How long before a deadline to stop sleeping and start spinning.
+ * This follows how far the system's sleep tends to overshoot.
+ */
+#define	MIN_SPIN_NS	100000
+#define	MAX_SPIN_NS	2000000
+static qint64	spinns = MAX_SPIN_NS;
+
+/* The lateness histogram, in 10-microsecond buckets, with the last
+ * bucket counting everything beyond it.
+ */
+#define	LATE_BUCKET_NS	10000
+#define	LATE_BUCKETS	201
+
+/* The running totals for the jitter statistics. They are updated by
+ * whichever thread is waiting on the timer (the playback thread during
+ * a replay), and may be read at any time, hence the atomics.
+ */
+static std::atomic<long>	statticks(0);
+static std::atomic<long>	statmissed(0);
+static std::atomic<qint64>	statlatetotal(0);
+static std::atomic<qint64>	statlatemax(0);
+static std::atomic<unsigned>	statlatehist[LATE_BUCKETS];
+
+/* While profiling, the statistics are also displayed every so often
+ * as the game runs, and this is when they are next due.
+ */
+#define	STATS_INTERVAL_NS	((qint64)10 * 1000000000)
+static qint64	statreportat = 0;
 
 /* Set the length (in real time) of a second of game time. A value of
  * zero selects the default length of one second.
  */
 void settimersecond(int ms)
 {
-	mspertick = (ms ? ms : 1000) / TICKS_PER_SECOND;
+	nspertick = (ms ? ms : 1000) * (qint64)1000000 / TICKS_PER_SECOND;
+}
+
+/* Turn turbo timing on or off. When it is turned off, the timer picks
+ * up from the current time instead of trying to catch up.
+ */
+void settimerturbo(int framems)
+{
+	turboframems = framems;
+}
+
+/* Return TRUE if turbo timing is on.
+ */
+bool timerturbo(void)
+{
+	return turboframems != 0;
 }
 
 /* Change the current timer setting. If action is positive, the timer
@@ -57,12 +109,12 @@ void settimer(int action)
 		utick = 0;
 	} else if (action > 0) {
 		if (nexttickat < 0)
-			nexttickat = qtimer.elapsed() - nexttickat;
+			nexttickat = qtimer.nsecsElapsed() - nexttickat;
 		else
-			nexttickat = qtimer.elapsed() + mspertick;
+			nexttickat = qtimer.nsecsElapsed() + nspertick;
 	} else {
 		if (nexttickat > 0)
-			nexttickat = qtimer.elapsed() - nexttickat;
+			nexttickat = qtimer.nsecsElapsed() - nexttickat;
 	}
 }
 
@@ -73,33 +125,119 @@ int gettickcount(void)
 	return (int)utick;
 }
 
+/* Set the tick counter, as when resuming a game from a snapshot.
+ */
+void settickcount(int tick)
+{
+	utick = tick;
+}
+
+/* Display the jitter statistics gathered so far on stdout.
+ */
+static void printtimerstats(void)
+{
+	timerstats	stats;
+
+	gettimerstats(&stats);
+	if (stats.ticks + stats.missed)
+		printf("Tick timing: %ld ticks waited for, %ld missed;"
+		       " lateness mean %.0f us, p99 %.0f us, max %.0f us\n",
+			stats.ticks, stats.missed,
+			stats.meanlate, stats.p99late, stats.maxlate);
+	fflush(stdout);
+}
+
+/* Add one tick's lateness to the jitter statistics, and display them
+ * if the program is being profiled and they are due.
+ */
+static void recordlateness(qint64 now, qint64 late)
+{
+	qint64	bucket;
+
+	++statticks;
+	statlatetotal += late;
+	if (late > statlatemax)
+		statlatemax = late;
+	bucket = late / LATE_BUCKET_NS;
+	++statlatehist[bucket < LATE_BUCKETS ? bucket : LATE_BUCKETS - 1];
+
+	if (profiling && now >= statreportat) {
+		if (statreportat)
+			printtimerstats();
+		statreportat = now + STATS_INTERVAL_NS;
+	}
+}
+
+/* Sleep until shortly before the deadline, and then spin the rest of
+ * the way, so as to wake up on time without relying on the precision
+ * of the system's sleep. The spin margin grows at once when a sleep
+ * overshoots by more than half of it, and shrinks back slowly.
+ */
+static void sleepuntil(qint64 deadline)
+{
+	qint64	now, target, over;
+
+	target = deadline - spinns;
+	now = qtimer.nsecsElapsed();
+	if (target > now) {
+		QThread::usleep((target - now) / 1000);
+		over = qtimer.nsecsElapsed() - target;
+		if (over < 0)
+			over = 0;
+		if (2 * over > spinns)
+			spinns = 2 * over;
+		else
+			spinns -= (spinns - 2 * over) / 16;
+		if (spinns < MIN_SPIN_NS)
+			spinns = MIN_SPIN_NS;
+		else if (spinns > MAX_SPIN_NS)
+			spinns = MAX_SPIN_NS;
+	}
+	while (qtimer.nsecsElapsed() < deadline)
+		QThread::yieldCurrentThread();
+}
+
 /* Put the program to sleep until the next timer tick. If we've
- * already missed a timer tick, then wait for the next one.
+ * already missed a timer tick, then wait for the next one. Under
+ * turbo timing, return at once, and return TRUE only if a frame is
+ * due.
  */
 bool waitfortick()
 {
-	int	ms;
+	qint64	now;
+	int	framems;
 
-	ms = nexttickat - qtimer.elapsed();
-
-#ifndef NDEBUG
-	if (ms < (int)(sizeof hist / sizeof *hist))
-		++hist[ms >= 0 ? ms + 1 : 0];
-#endif
+	framems = turboframems;
+	if (framems) {
+		if (!inturbo) {
+			inturbo = true;
+			nextframeat = 0;
+		}
+		++utick;
+		now = qtimer.elapsed();
+		if (now < nextframeat)
+			return false;
+		nextframeat = now + framems;
+		return true;
+	}
+	if (inturbo) {
+		inturbo = false;
+		nexttickat = qtimer.nsecsElapsed() + nspertick;
+	}
 
-	if (ms <= 0) {
+	if (nexttickat <= qtimer.nsecsElapsed()) {
+		++statmissed;
 		++utick;
-		nexttickat += mspertick;
+		nexttickat += nspertick;
 		return false;
 	}
 
-	while (ms < 0)
-		ms += mspertick;
-
-	QThread::usleep(ms * 1000);
+	sleepuntil(nexttickat);
+	now = qtimer.nsecsElapsed();
+	recordlateness(now, now - nexttickat);
 
 	++utick;
-	nexttickat += mspertick;
+	nexttickat += nspertick;
 	return true;
 }
 
@@ -110,28 +248,41 @@ int advancetick(void)
 	return ++utick;
 }
 
-/* At shutdown time, display the histogram data on stdout.
+/* Return the jitter statistics gathered so far.
+ */
+void gettimerstats(timerstats *stats)
+{
+	long	ticks, n, limit;
+	int	i;
+
+	ticks = statticks;
+	stats->ticks = ticks;
+	stats->missed = statmissed;
+	stats->meanlate = ticks ? statlatetotal / 1000.0 / ticks : 0.0;
+	stats->maxlate = statlatemax / 1000.0;
+	stats->p99late = 0.0;
+	limit = ticks - ticks / 100;
+	for (i = 0, n = 0 ; i < LATE_BUCKETS && ticks ; ++i) {
+		n += statlatehist[i];
+		if (n >= limit) {
+			stats->p99late = (i + 1) * (LATE_BUCKET_NS / 1000.0);
+			break;
+		}
+	}
+}
+
+/* At shutdown time, display the jitter statistics on stdout if the
+ * program is being profiled, or if this is a debugging build.
  */
 static void shutdown(void)
 {
 	settimer(-1);
 
-#ifndef NDEBUG
-	unsigned long	n;
-	int			i;
-
-	n = 0;
-	for (i = 0 ; i < (int)(sizeof hist / sizeof *hist) ; ++i)
-		n += hist[i];
-	if (n) {
-		puts("Histogram of idle time (ms/tick)");
-		if (hist[0])
-			printf("NEG: %.1f%%\n", (hist[0] * 100.0) / n);
-		for (i = 1 ; i < (int)(sizeof hist / sizeof *hist) ; ++i)
-			if (hist[i])
-				printf("%3d: %.1f%%\n", i - 1, (hist[i] * 100.0) / n);
-	}
+#ifdef NDEBUG
+	if (!profiling)
+		return;
 #endif
+	printtimerstats();
 }
 
 
@@ -18,10 +18,25 @@ extern void settimer(int action);
  */
 extern void settimersecond(int ms);
 
+/* Turn turbo timing on or off. While it is on, waitfortick() does not
+ * sleep, and returns TRUE only when at least framems milliseconds
+ * have passed since it last did so. A value of zero turns it off.
+ */
+extern void settimerturbo(int framems);
+
+/* Return TRUE if turbo timing is on.
+ */
+extern bool timerturbo(void);
+
 /* Return the number of ticks since the timer was last reset.
  */
 extern int gettickcount(void);
 
+/* Set the tick counter to the given value without otherwise
+ * affecting the timer.
+ */
+extern void settickcount(int tick);
+
 /* Put the program to sleep until the next timer tick.
  */
 extern bool waitfortick(void);
@@ -30,6 +45,26 @@ extern bool waitfortick(void);
  */
 extern int advancetick(void);
 
+/* Statistics on how closely the timer has kept to its deadlines.
+ * Lateness is measured from a tick's deadline to the moment that
+ * waitfortick() returned. Ticks that were already overdue when
+ * waitfortick() was called are counted as missed instead.
+ */
+typedef struct timerstats {
+	long	ticks;		/* ticks waited for */
+	long	missed;		/* ticks already overdue */
+	double	meanlate;	/* mean lateness, in microseconds */
+	double	p99late;	/* 99th percentile lateness, to within 10 us */
+	double	maxlate;	/* worst lateness, in microseconds */
+} timerstats;
+
+/* Fill in stats with the statistics gathered since the program
+ * started. This may be called at any time, from any thread; while
+ * the program is being profiled, the statistics are also displayed
+ * on stdout every ten seconds or so of play.
+ */
+extern void gettimerstats(timerstats *stats);
+
 /* Initialisation function
  */
 
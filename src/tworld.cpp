@@ -7,6 +7,12 @@
  */
 
 #include	<QString>
+#include	<algorithm>
+#include	<atomic>
+#include	<chrono>
+#include	<condition_variable>
+#include	<mutex>
+#include	<thread>
 #include	<vector>
 
 #include	"TWApp.h"
@@ -553,6 +559,81 @@ static bool finalinput(gamespec *gs)
 	}
 }
 
+/*
+ * Rewinding live play.
+ */
+
+/* How many snapshots are kept for rewinding, and how many ticks apart
+ * they are taken.
+ */
+#define	REWIND_SNAPSHOTS	60
+#define	REWIND_INTERVAL		TICKS_PER_SECOND
+
+/* A ring buffer of snapshots of the game being played, covering the
+ * last minute or so. The slots' memory is reused from one attempt to
+ * the next.
+ */
+static gamesnapshot    *rewindring[REWIND_SNAPSHOTS];
+static int		rewindnext = 0;		/* the slot to fill next */
+static int		rewindcount = 0;	/* the number of slots in use */
+
+/* Forget all rewind points.
+ */
+static void clearrewindpoints(void)
+{
+	rewindnext = 0;
+	rewindcount = 0;
+}
+
+/* Take a snapshot of the game if it is at a tick that is due one,
+ * overwriting the oldest snapshot if the ring is full. Nothing is
+ * taken if the latest snapshot is already of this tick, as it is when
+ * play resumes after a rewind.
+ */
+static void recordrewindpoint(void)
+{
+	int	tick, last;
+
+	tick = gettickcount();
+	if (tick <= 0 || tick % REWIND_INTERVAL)
+		return;
+	last = (rewindnext + REWIND_SNAPSHOTS - 1) % REWIND_SNAPSHOTS;
+	if (rewindcount && gamesnapshottime(rewindring[last]) + 1 == tick)
+		return;
+	rewindring[rewindnext] = savegamesnapshot(rewindring[rewindnext]);
+	rewindnext = (rewindnext + 1) % REWIND_SNAPSHOTS;
+	if (rewindcount < REWIND_SNAPSHOTS)
+		++rewindcount;
+}
+
+/* Return the game to the latest snapshot that is at least half a
+ * second before the current tick, discarding any later snapshots. The
+ * moves made since then are dropped, and the attempt is marked so that
+ * it cannot be saved as a solution. FALSE is returned if there is no
+ * such snapshot.
+ */
+static bool rewindgame(void)
+{
+	gamesnapshot   *snap;
+	int		tick, last;
+
+	tick = gettickcount();
+	while (rewindcount) {
+		last = (rewindnext + REWIND_SNAPSHOTS - 1) % REWIND_SNAPSHOTS;
+		snap = rewindring[last];
+		if (gamesnapshottime(snap) + 1 <= tick - REWIND_INTERVAL / 2) {
+			if (!restoregamesnapshot(snap))
+				break;
+			settickcount(gamesnapshottime(snap) + 1);
+			disablesaving();
+			return true;
+		}
+		rewindnext = last;
+		--rewindcount;
+	}
+	return false;
+}
+
 #define SETPAUSED(paused, shutter) do { \
 	if(!paused) { \
 		setgameplaymode(NormalPlay); \
@@ -594,10 +675,12 @@ static bool playgame(gamespec *gs, int firstcmd)
 
 	bool gamepaused = false;
 	g_pMainWnd->SetPlayPauseButton(gamepaused);
+	clearrewindpoints();
 	for (;;) {
 		if (gamepaused)
 			cmd = g_pMainWnd->Input(true);
 		else {
+			recordrewindpoint();
 			n = doturn(cmd);
 			drawscreen(render);
 			lastrendered = render;
@@ -625,6 +708,15 @@ static bool playgame(gamespec *gs, int firstcmd)
 				if (!gamepaused)
 					cmd = CmdNone;
 				break;
+			case CmdRewind:
+				if (rewindgame()) {
+					SETPAUSED(true, false);
+					drawscreen(true);
+				} else {
+					TileWorldApp::Bell();
+				}
+				cmd = CmdNone;
+				break;
 #ifndef NDEBUG
 			case CmdDebugCmd1:				break;
 			case CmdDebugCmd2:				break;
@@ -662,10 +754,104 @@ quitloop:
 	return false;
 }
 
+/*
+ * Keyframes for seeking within solution playback.
+ */
+
+/* The memory budget for keyframes in megabytes, if the
+ * "keyframebudget" setting is absent. A setting of zero turns
+ * keyframes off.
+ */
+#define	DEFAULT_KEYFRAME_BUDGET	32
+
+/* Snapshots of the game taken during playback of a solution, so that
+ * seeking doesn't have to replay from the start. keyframes[i] holds
+ * the game as it was just before tick i * keyframeinterval.
+ */
+static std::vector<gamesnapshot*> keyframes;
+static int	keyframeinterval = TICKS_PER_SECOND;
+static size_t	keyframememory = 0;
+
+/* The memory budget for keyframes in megabytes, read from the
+ * settings when the keyframes are cleared, since they are recorded
+ * on the playback thread.
+ */
+static int	keyframebudget = DEFAULT_KEYFRAME_BUDGET;
+
+/* Discard all keyframes.
+ */
+static void clearkeyframes(void)
+{
+	for (gamesnapshot *snap : keyframes)
+		freegamesnapshot(snap);
+	keyframes.clear();
+	keyframeinterval = TICKS_PER_SECOND;
+	keyframememory = 0;
+	keyframebudget = getintsetting("keyframebudget");
+	if (keyframebudget < 0)
+		keyframebudget = DEFAULT_KEYFRAME_BUDGET;
+}
+
+/* Discard every other keyframe, doubling the interval between them.
+ */
+static void thinkeyframes(void)
+{
+	size_t	i, j;
+
+	for (i = j = 0 ; i < keyframes.size() ; ++i) {
+		if (i % 2) {
+			keyframememory -= gamesnapshotsize(keyframes[i]);
+			freegamesnapshot(keyframes[i]);
+		} else {
+			keyframes[j++] = keyframes[i];
+		}
+	}
+	keyframes.resize(j);
+	keyframeinterval *= 2;
+}
+
+/* Take a keyframe of the current game if it has reached a tick that
+ * is due one. When the keyframes outgrow their memory budget they are
+ * thinned out, so that they always span the whole of the playback.
+ */
+static void recordkeyframe(void)
+{
+	gamesnapshot   *snap;
+	int		tick;
+
+	tick = gettickcount();
+	if (tick % keyframeinterval
+		|| tick / keyframeinterval != (int)keyframes.size())
+		return;
+	if (!keyframebudget)
+		return;
+
+	snap = savegamesnapshot(NULL);
+	keyframememory += gamesnapshotsize(snap);
+	keyframes.push_back(snap);
+	while (keyframes.size() > 1
+		&& keyframememory > (size_t)keyframebudget << 20)
+		thinkeyframes();
+}
+
+/* Return the latest keyframe from before the given number of seconds
+ * into the game, or NULL if there is none.
+ */
+static gamesnapshot *findkeyframe(int seconds)
+{
+	for (size_t i = keyframes.size() ; i-- ; )
+		if ((gamesnapshottime(keyframes[i]) + 1) / TICKS_PER_SECOND < seconds)
+			return keyframes[i];
+	return NULL;
+}
+
 /* Skip past secondstoskip seconds from the beginning of the solution.
+ * Play resumes from the nearest earlier keyframe, if there is one, and
+ * only the remainder is simulated.
  */
 static int hideandseek(gamespec *gs, int secondstoskip)
 {
+	gamesnapshot   *snap;
 	int n = 0;
 
 	quitgamestate();
@@ -679,7 +865,12 @@ static int hideandseek(gamespec *gs, int secondstoskip)
 	gs->status = 0;
 	setgameplaymode(NonrenderPlay);
 
+	snap = findkeyframe(secondstoskip);
+	if (snap && restoregamesnapshot(snap))
+		settickcount(gamesnapshottime(snap) + 1);
+
 	while (secondsplayed() < secondstoskip) {
+		recordkeyframe();
 		n = doturn(CmdNone);
 		if (n)
 			break;
@@ -692,19 +883,176 @@ static int hideandseek(gamespec *gs, int secondstoskip)
 	return n;
 }
 
+/*
+ * The playback thread.
+ */
+
+/* While a solution is played back, the game is run on a thread of its
+ * own, which leaves copies of the game for the display to pick up. The
+ * frames are triple-buffered: the thread fills back, and swaps it with
+ * middle; the display swaps middle with front, and shows front. Thus
+ * a slow redraw never holds up the game's timer.
+ */
+/* How long the display waits for a new frame before it checks for
+ * input again, in milliseconds.
+ */
+#define	PLAYBACK_POLL_MS	5
+
+typedef struct playbackthread {
+	std::thread		thread;
+	std::mutex		lock;
+	std::condition_variable	changed;	/* signals a new frame */
+	std::atomic<bool>	stop;		/* asks the thread to stop */
+	gameframe	       *back;
+	gameframe	       *middle;
+	gameframe	       *front;
+	bool			fresh;		/* TRUE if middle is new */
+	bool			finished;	/* TRUE if the game has ended */
+	int			status;		/* the last value of doturn() */
+} playbackthread;
+
+/* The playback thread that is running, if any. exit() does not unwind
+ * playbackgame(), so if the program exits during a replay (as when the
+ * window is closed), the thread is stopped from an atexit handler. The
+ * handler is registered after everything else's, so it runs first,
+ * before anything that the thread is using is torn down.
+ */
+static playbackthread  *runningplayback = NULL;
+
+/* Hand a copy of the current game to the display.
+ */
+static void publishframe(playbackthread *pt, int status)
+{
+	pt->back = savegameframe(pt->back);
+	std::lock_guard<std::mutex> hold(pt->lock);
+	std::swap(pt->back, pt->middle);
+	pt->fresh = true;
+	pt->finished = status != 0;
+	pt->status = status;
+	pt->changed.notify_one();
+}
+
+/* The body of the playback thread. This runs the same loop that
+ * playgame() does, minus the input and the display, until the game
+ * ends or the thread is asked to stop.
+ */
+static void runplayback(playbackthread *pt)
+{
+	bool	render = true;
+	int	n;
+
+	while (!pt->stop) {
+		recordkeyframe();
+		n = doturn(CmdNone);
+		drawscreen(false);
+		if (render || n)
+			publishframe(pt, n);
+		if (n)
+			break;
+		render = waitfortick() || (noframeskip && !timerturbo());
+	}
+}
+
+/* Stop the playback thread, if it is running, and return the display
+ * to the current game. The return value is the game's final doturn()
+ * value if the game ended before the thread stopped, or zero.
+ */
+static int stopplayback(playbackthread *pt)
+{
+	if (pt->thread.joinable()) {
+		pt->stop = true;
+		pt->thread.join();
+		runningplayback = NULL;
+		showgameframe(NULL);
+	}
+	return pt->finished ? pt->status : 0;
+}
+
+/* Stop whichever playback thread is running when the program exits,
+ * unless it is the playback thread itself that is exiting.
+ */
+static void stoprunningplayback(void)
+{
+	if (runningplayback && runningplayback->thread.get_id()
+				   != std::this_thread::get_id())
+		stopplayback(runningplayback);
+}
+
+/* Start running the current game on the playback thread. The display
+ * is first given a frame of its own, so that it never looks at the
+ * game while the thread is running it.
+ */
+static void startplayback(playbackthread *pt)
+{
+	static bool	registered = false;
+
+	if (!registered) {
+		registered = true;
+		atexit(stoprunningplayback);
+	}
+	pt->front = savegameframe(pt->front);
+	showgameframe(pt->front);
+	pt->stop = false;
+	pt->fresh = false;
+	pt->finished = false;
+	pt->status = 0;
+	pt->thread = std::thread(runplayback, pt);
+	runningplayback = pt;
+}
+
+/* Display the latest frame from the playback thread, if there is a new
+ * one, waiting up to the given number of milliseconds for it to show
+ * up. TRUE is returned once the frame of the game's final tick has
+ * been displayed.
+ */
+static bool showplayback(playbackthread *pt, int ms)
+{
+	bool	finished;
+
+	{
+		std::unique_lock<std::mutex> hold(pt->lock);
+		if (!pt->fresh && ms > 0)
+			pt->changed.wait_for(hold, std::chrono::milliseconds(ms));
+		if (!pt->fresh)
+			return false;
+		std::swap(pt->middle, pt->front);
+		pt->fresh = false;
+		finished = pt->finished;
+	}
+	showgameframe(pt->front);
+	return finished;
+}
+
+/* Free the playback thread's frames.
+ */
+static void freeplayback(playbackthread *pt)
+{
+	stopplayback(pt);
+	freegameframe(pt->back);
+	freegameframe(pt->middle);
+	freegameframe(pt->front);
+	pt->back = pt->middle = pt->front = NULL;
+}
+
 /* Play back the user's best solution for the current level in real
  * time. Other than the fact that this function runs from a
  * prerecorded series of moves, it has the same behavior as
- * playgame().
+ * playgame(), except that the game itself runs on the playback
+ * thread, and this thread only displays it and handles input.
  */
 static bool playbackgame(gamespec *gs)
 {
-	bool	render, lastrendered;
+	playbackthread	pt;
 	int n = 0, cmd;
 	int secondstoskip;
 	bool gamepaused = false;
 	g_pMainWnd->SetPlayPauseButton(gamepaused);
 
+	pt.back = pt.middle = pt.front = NULL;
+	pt.fresh = pt.finished = false;
+	pt.status = 0;
+
+	clearkeyframes();
 	secondstoskip = g_pMainWnd->GetReplaySecondsToSkip();
 	if (secondstoskip > 0) {
 		n = hideandseek(gs, secondstoskip);
@@ -715,48 +1063,57 @@ static bool playbackgame(gamespec *gs)
 		setgameplaymode(NormalPlay);
 	}
 
-	render = lastrendered = true;
-
 	while (!n) {
 		if (gamepaused) {
 			setgameplaymode(SuspendPlay);
 			cmd = g_pMainWnd->Input(true);
 		} else {
-			n = doturn(CmdNone);
-			drawscreen(render);
-			lastrendered = render;
-			if (n)
-				break;
-			render = waitfortick() || noframeskip;
+			if (!pt.thread.joinable())
+				startplayback(&pt);
 			cmd = g_pMainWnd->Input(false);
+			if (showplayback(&pt, cmd == CmdNone ? PLAYBACK_POLL_MS : 0)) {
+				n = stopplayback(&pt);
+				break;
+			}
 		}
 		switch (cmd) {
 		case CmdSeek:
 		case CmdWest:
 		case CmdEast:
+			stopplayback(&pt);
 			if (cmd == CmdSeek) {
 				secondstoskip = g_pMainWnd->GetReplaySecondsToSkip();
 			} else {
 				secondstoskip = secondsplayed() + ((cmd == CmdEast) ? +3 : -3);
 			}
 			n = hideandseek(gs, secondstoskip);
-			lastrendered = true;
 			break;
-		case CmdPrevLevel:	changecurrentgame(gs, -1);	goto quitloop;
-		case CmdNextLevel:	changecurrentgame(gs, +1);	goto quitloop;
+		case CmdPrevLevel:
+			freeplayback(&pt);
+			changecurrentgame(gs, -1);
+			goto quitloop;
+		case CmdNextLevel:
+			freeplayback(&pt);
+			changecurrentgame(gs, +1);
+			goto quitloop;
 		case CmdSameLevel:
 		case CmdPlayback:
 		case CmdQuitLevel:	goto quitloop;
-		case CmdQuit:			exit(0);
+		case CmdQuit:		stopplayback(&pt);	exit(0);
 		case CmdLostFocus:
 			if(gamepaused) break;
 		case CmdPauseGame:
+			if (!gamepaused) {
+				if ((n = stopplayback(&pt)))
+					break;
+				drawscreen(true);
+			}
 			SETPAUSED(!gamepaused, false);
 			break;
 		}
 	}
-	if (!lastrendered)
-		drawscreen(true);
+	freeplayback(&pt);
+	drawscreen(true);
 	setgameplaymode(EndPlay);
 	gs->playmode = Play_None;
 	if (n < 0)
@@ -766,14 +1123,16 @@ static bool playbackgame(gamespec *gs)
 			savesolutions(&gs->series);
 	}
 	gs->status = n;
+	clearkeyframes();
 	return true;
 
 quitloop:
-	if (!lastrendered)
-		drawscreen(true);
+	freeplayback(&pt);
+	drawscreen(true);
 	quitgamestate();
 	setgameplaymode(EndPlay);
 	gs->playmode = Play_None;
+	clearkeyframes();
 	return false;
 }
 
@@ -972,6 +1331,45 @@ static int chooseseries(std::vector<gameseries> &serieslist, uint *game, uint *r
 	return CmdProceed;
 }
 
+/* Move the series selected by game, ruleset and dac out of serieslist
+ * and into the gamespec, and free the rest of the list.
+ */
+static void takeseries(gamespec *gs, std::vector<gameseries> &serieslist, uint game, uint ruleset, uint dac)
+{
+	// move the selected series to the gamespec
+	gs->series = std::move(serieslist[game]);
+
+	// copy some dac info over to gameseries
+	stringcopy(gs->series.name, gs->series.dacfiles[ruleset][dac].filename, (int)(sizeof gs->series.name));
+	gs->series.lastlevel = gs->series.dacfiles[ruleset][dac].lastlevel;
+	gs->series.ruleset = gs->series.dacfiles[ruleset][dac].ruleset;
+	gs->series.gsflags = gs->series.dacfiles[ruleset][dac].gsflags;
+
+	// free all the other series
+	freeserieslist(serieslist, game);
+
+	// ... and gamespec's dacfilelist
+	freedacfilelist(gs->series.dacfiles);
+}
+
+/* Read the levels and solutions of the gamespec's series. FALSE is
+ * returned, and the series freed, if no levels could be read.
+ */
+static bool loadseries(gamespec *gs)
+{
+	if (!readseriesfile(&gs->series)) {
+		warn("%s: cannot read data file", gs->series.name);
+		freeseriesdata(&gs->series);
+		return false;
+	}
+	if (gs->series.count < 1) {
+		warn("%s: no levels found in data file", gs->series.name);
+		freeseriesdata(&gs->series);
+		return false;
+	}
+	return true;
+}
+
 /* Display the full selection of available series to the user as a
  * scrolling list, and permit one to be selected. When one is chosen,
  * pick one of levels to be the current level. All fields of the
@@ -1025,34 +1423,13 @@ static int selectseriesandlevel(gamespec *gs, std::vector<gameseries> &serieslis
 		}
 	}
 
-	// move the selected series to the gamespec
-	gs->series = std::move(serieslist[game]);
-
-	// copy some dac info over to gameseries
-	stringcopy(gs->series.name, gs->series.dacfiles[ruleset][dac].filename, (int)(sizeof gs->series.name));
-	gs->series.lastlevel = gs->series.dacfiles[ruleset][dac].lastlevel;
-	gs->series.ruleset = gs->series.dacfiles[ruleset][dac].ruleset;
-	gs->series.gsflags = gs->series.dacfiles[ruleset][dac].gsflags;
-
-	// free all the other series
-	freeserieslist(serieslist, game);
-
-	// ... and gamespec's dacfilelist
-	freedacfilelist(gs->series.dacfiles);
+	takeseries(gs, serieslist, game, ruleset, dac);
 
 	// change the selected series setting
 	setstringsetting("selectedseries", gs->series.name);
 
-	if (!readseriesfile(&gs->series)) {
-		warn("%s: cannot read data file", gs->series.name);
-		freeseriesdata(&gs->series);
+	if (!loadseries(gs))
 		return -1;
-	}
-	if (gs->series.count < 1) {
-		warn("%s: no levels found in data file", gs->series.name);
-		freeseriesdata(&gs->series);
-		return -1;
-	}
 
 	gs->enddisplay = false;
 	gs->playmode = Play_None;
@@ -1126,3 +1503,167 @@ int tworld()
 
 	return (f == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
+
+/*
+ * Headless verification.
+ */
+
+/* The outcome of replaying one level's solution.
+ */
+struct verifyresult {
+	int		status;		/* as returned by replaysolution() */
+	int		currenttime;	/* the tick count when the replay ended */
+	int		timeoffset;	/* the game's time offset at that point */
+};
+
+/* Replay levels from the shared queue until it is empty. Each worker
+ * claims the next unclaimed level, so a thread that draws short
+ * solutions simply goes back for more while another is still busy
+ * with a long one. Only the worker's own slots in results are written.
+ */
+static void verifyworker(gameseries *series, std::vector<int> const *queue,
+	std::atomic<size_t> *next, std::vector<verifyresult> *results)
+{
+	size_t	n;
+
+	while ((n = next->fetch_add(1)) < queue->size()) {
+		int index = (*queue)[n];
+		verifyresult *r = &(*results)[index];
+		r->status = replaysolution(series->games + index, series->ruleset,
+			&r->currenttime, &r->timeoffset);
+	}
+}
+
+/* Replay every saved solution in the series using the given number of
+ * threads. The longest solutions are handed out first, so that no
+ * worker is left with a long replay once everyone else has finished.
+ */
+static void verifyseries(gameseries *series, int jobs,
+	std::vector<verifyresult> &results)
+{
+	std::vector<std::thread>	workers;
+	std::vector<int>		queue;
+	std::atomic<size_t>		next(0);
+
+	results.assign(series->count, verifyresult { 0, 0, 0 });
+	for (int i = 0 ; i < series->count ; ++i)
+		if (hassolution(series->games + i))
+			queue.push_back(i);
+	std::stable_sort(queue.begin(), queue.end(), [series](int a, int b) {
+		return series->games[a].besttime > series->games[b].besttime;
+	});
+
+	if (jobs > (int)queue.size())
+		jobs = (int)queue.size();
+	for (int i = 1 ; i < jobs ; ++i)
+		workers.emplace_back(verifyworker, series, &queue, &next, &results);
+	verifyworker(series, &queue, &next, &results);
+	for (std::thread &t : workers)
+		t.join();
+}
+
+/* Merge the outcome of replaying one level back into its setup, and
+ * print it. The return value is positive if the solution completes
+ * the level, negative if it does not, and zero if the level has no
+ * solution to replay.
+ */
+static int reportlevel(gamesetup *game, verifyresult const *r)
+{
+	int	recorded, ticks;
+
+	printf("%3d  %-36.36s  ", game->number, game->name);
+
+	if (!hassolution(game)) {
+		puts("no solution");
+		return 0;
+	}
+	if (!r->status) {
+		puts("FAIL  (invalid level or solution)");
+		return -1;
+	}
+
+	ticks = r->currenttime + r->timeoffset;
+	if (r->status < 0) {
+		printf("FAIL  %7d ticks\n", ticks);
+		return -1;
+	}
+	recorded = game->besttime;
+	fflush(stdout);
+	checksolutiontime(game, r->currenttime, r->timeoffset);
+	if (ticks != recorded)
+		printf("pass  %7d ticks  (recorded as %d)\n", ticks, recorded);
+	else
+		printf("pass  %7d ticks\n", ticks);
+	return +1;
+}
+
+/* Verify every solution for the series described by the named dac
+ * file, printing a line per level and a final summary. solutionfile,
+ * if not NULL, names the solution file to use instead of the default.
+ * Both are file names, looked up in the usual directories; a name that
+ * includes a path is rejected rather than quietly resolved elsewhere.
+ * jobs is the number of levels to replay at once; zero means one per
+ * available core. Nothing is written back to the solution file. The
+ * return value is suitable for use as the program's exit status.
+ */
+int tworldverify(char const *dacname, char const *solutionfile, int jobs)
+{
+	std::vector<gameseries> serieslist;
+	std::vector<verifyresult> results;
+	gamespec	spec;
+	uint	game, ruleset, dac;
+	int		passed = 0, failed = 0, unsolved = 0;
+
+	if (strpbrk(dacname, "/\\")) {
+		warn("%s: give the name of a file in the sets directory,"
+		     " not a path", dacname);
+		return EXIT_FAILURE;
+	}
+	if (solutionfile && strpbrk(solutionfile, "/\\")) {
+		warn("%s: give the name of a file in the solutions directory,"
+		     " not a path", solutionfile);
+		return EXIT_FAILURE;
+	}
+
+	if (!createserieslist(serieslist))
+		return EXIT_FAILURE;
+	if (!findseries(serieslist, dacname, &game, &ruleset, &dac)) {
+		warn("%s: no such level set", dacname);
+		freeserieslist(serieslist);
+		return EXIT_FAILURE;
+	}
+	takeseries(&spec, serieslist, game, ruleset, dac);
+
+	if (solutionfile) {
+		x_cmalloc(spec.series.savefilename, strlen(solutionfile) + 1);
+		strcpy(spec.series.savefilename, solutionfile);
+	}
+
+	if (!loadseries(&spec))
+		return EXIT_FAILURE;
+
+	if (jobs <= 0)
+		jobs = std::thread::hardware_concurrency();
+	if (jobs <= 0)
+		jobs = 1;
+
+	printf("%s (%s)\n", spec.series.name,
+		spec.series.ruleset == Ruleset_MS ? "MS" : "Lynx");
+	fflush(stdout);
+	verifyseries(&spec.series, jobs, results);
+	for (int i = 0 ; i < spec.series.count ; ++i) {
+		int n = reportlevel(spec.series.games + i, &results[i]);
+		if (n > 0)
+			++passed;
+		else if (n < 0)
+			++failed;
+		else
+			++unsolved;
+	}
+	printf("%d passed, %d failed, %d without solutions\n",
+		passed, failed, unsolved);
+
+	shutdowngamestate();
+	freeseriesdata(&spec.series);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -29,6 +29,14 @@ typedef	struct gamespec {
  */
 extern int tworld();
 
+/* Verify every saved solution for a levelset without a user
+ * interface and report the results on stdout. solutionfile may be
+ * NULL to use the levelset's default solution file. jobs is the
+ * number of levels to replay in parallel, or zero to use every core.
+ */
+extern int tworldverify(char const *dacname, char const *solutionfile,
+			int jobs);
+
 /* Load the levelset history.
  */
 extern bool loadhistory();